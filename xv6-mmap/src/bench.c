@@ -0,0 +1,210 @@
+// Timing and reporting helpers shared by the *bench programs.
+// See bench.h for the output format.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "bench.h"
+
+char *benchname = "bench";
+uint benchmhz;
+int benchmaxproc = BENCHMAXPROC;
+int benchbytes;
+
+// Measure the TSC rate against the timer tick (10ms) and
+// print it, so readers can convert cycles to time.
+void
+benchinit(char *name)
+{
+  uint t;
+  uint64 t0;
+
+  benchname = name;
+  t = uptime();
+  while(uptime() == t)
+    ;
+  t0 = rdtsc();
+  t = uptime();
+  while(uptime() < t + 10)
+    ;
+  benchmhz = udiv64(rdtsc() - t0, 100000);
+  printf(1, "%s mhz=%u\n", name, benchmhz);
+}
+
+// Sort samples (in place) and compute their summary.
+void
+benchsummary(uint *s, int n, struct benchstats *st)
+{
+  int gap, i, j;
+  uint x;
+  uint64 sum;
+
+  for(gap = n/2; gap > 0; gap /= 2)
+    for(i = gap; i < n; i++)
+      for(j = i-gap; j >= 0 && s[j] > s[j+gap]; j -= gap){
+        x = s[j];
+        s[j] = s[j+gap];
+        s[j+gap] = x;
+      }
+
+  memset(st, 0, sizeof(*st));
+  st->n = n;
+  if(n == 0)
+    return;
+  sum = 0;
+  for(i = 0; i < n; i++)
+    sum += s[i];
+  st->min = s[0];
+  st->p50 = s[(n-1)*50/100];
+  st->p90 = s[(n-1)*90/100];
+  st->p99 = s[(n-1)*99/100];
+  st->max = s[n-1];
+  st->mean = udiv64(sum, n);
+}
+
+// Format "key=val" into buf and return buf.
+char*
+benchparam(char *buf, char *key, uint val)
+{
+  char tmp[12];
+  int i, n;
+
+  strcpy(buf, key);
+  n = strlen(buf);
+  buf[n++] = '=';
+  i = 0;
+  do {
+    tmp[i++] = '0' + val % 10;
+  } while((val /= 10) != 0);
+  while(i > 0)
+    buf[n++] = tmp[--i];
+  buf[n] = 0;
+  return buf;
+}
+
+static int
+readall(int fd, void *buf, int n)
+{
+  int m, r;
+
+  for(m = 0; m < n; m += r)
+    if((r = read(fd, (char*)buf + m, n - m)) <= 0)
+      break;
+  return m;
+}
+
+// Run fn in nproc concurrent child processes, each producing
+// n samples, and collect all nproc*n samples into samples.
+// The children start together once all have been forked.
+// *wall is set to the cycles from the start until the last
+// child's samples arrived.  Returns 0, or -1 on failure.
+int
+benchrun(int nproc, benchfn fn, void *arg, uint *samples, int n, uint64 *wall)
+{
+  int gate[2], p[2], fd[BENCHMAXPROC];
+  int i, m, pid, ok;
+  uint64 t0;
+  char c;
+
+  if(nproc < 1 || nproc > BENCHMAXPROC || pipe(gate) < 0)
+    return -1;
+  for(m = 0; m < nproc; m++){
+    if(pipe(p) < 0)
+      break;
+    if((pid = fork()) < 0){
+      close(p[0]);
+      close(p[1]);
+      break;
+    }
+    if(pid == 0){
+      close(gate[1]);
+      close(p[0]);
+      if(read(gate[0], &c, 1) != 1)
+        exit();
+      fn(m, samples, n, arg);
+      write(p[1], samples, n*sizeof(uint));
+      exit();
+    }
+    close(p[1]);
+    fd[m] = p[0];
+  }
+  close(gate[0]);
+
+  ok = m == nproc;
+  t0 = rdtsc();
+  if(ok)
+    for(i = 0; i < m; i++)
+      write(gate[1], "g", 1);
+  close(gate[1]);
+  for(i = 0; i < m; i++){
+    if(ok && readall(fd[i], samples + i*n, n*sizeof(uint)) != n*sizeof(uint))
+      ok = 0;
+    close(fd[i]);
+  }
+  *wall = rdtsc() - t0;
+  for(i = 0; i < m; i++)
+    wait();
+  return ok ? 0 : -1;
+}
+
+// Print one result line for the n samples of test, which
+// ran with nproc processes and took wall cycles in total.
+// params holds extra key=value fields, or "".  Sorts samples.
+void
+benchreport(char *test, char *params, int nproc, uint *s, int n, uint64 wall)
+{
+  struct benchstats st;
+  uint64 rate;
+
+  benchsummary(s, n, &st);
+  rate = 0;
+  if(wall)
+    rate = udiv64((uint64)n * benchmhz * 1000000, wall);
+  printf(1, "%s test=%s %s%snproc=%d n=%d min=%u p50=%u p90=%u p99=%u max=%u mean=%l wallus=%l opspersec=%l",
+         benchname, test, params, *params ? " " : "", nproc, st.n,
+         st.min, st.p50, st.p90, st.p99, st.max, st.mean,
+         udiv64(wall, benchmhz), rate);
+  if(benchbytes)
+    printf(1, " kbpersec=%l", udiv64(rate * benchbytes, 1024));
+  printf(1, "\n");
+}
+
+// Run fn with 1, 2, 4, ... benchmaxproc processes, n samples
+// each, and report each configuration.
+void
+benchsweep(char *test, char *params, benchfn fn, void *arg, int n)
+{
+  int nproc;
+  uint *s;
+  uint64 wall;
+
+  if((s = malloc(benchmaxproc * n * sizeof(uint))) == 0)
+    benchfail("malloc");
+  for(nproc = 1; nproc <= benchmaxproc; nproc *= 2){
+    if(benchrun(nproc, fn, arg, s, n, &wall) < 0)
+      benchfail(test);
+    benchreport(test, params, nproc, s, nproc*n, wall);
+  }
+  free(s);
+}
+
+// Is name one of the n names in list?  An empty list
+// selects everything.
+int
+benchselected(char *name, char **list, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(strcmp(name, list[i]) == 0)
+      return 1;
+  return n == 0;
+}
+
+void
+benchfail(char *what)
+{
+  printf(2, "%s: %s failed\n", benchname, what);
+  exit();
+}
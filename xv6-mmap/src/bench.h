@@ -0,0 +1,37 @@
+// Timing and reporting helpers shared by the *bench programs.
+//
+// Times are TSC cycles.  Every result is one line of
+// space-separated key=value fields starting with the program
+// name, e.g.
+//
+//   mmapbench test=mmap size=4096 nproc=2 n=200 min=... p50=...
+//
+// so runs can be compared with grep and a script.  wallus is
+// the elapsed time of the whole configuration, and kbpersec
+// appears when benchbytes is set.
+
+#define BENCHMAXPROC 8  // most concurrent processes in a sweep
+
+struct benchstats {
+  int n;          // number of samples
+  uint min, p50, p90, p99, max;
+  uint64 mean;
+};
+
+extern char *benchname;  // program name printed on each line
+extern uint benchmhz;    // TSC rate, measured by benchinit
+extern int benchmaxproc; // largest nproc in a benchsweep
+extern int benchbytes;   // bytes moved per operation, or 0
+
+// A benchmark body: fill samples[0..n-1] with per-operation
+// cycle counts.  id is 0..nproc-1 when run by benchrun.
+typedef void (*benchfn)(int id, uint *samples, int n, void *arg);
+
+void   benchinit(char*);
+void   benchsummary(uint*, int, struct benchstats*);
+char*  benchparam(char*, char*, uint);
+int    benchrun(int, benchfn, void*, uint*, int, uint64*);
+void   benchreport(char*, char*, int, uint*, int, uint64);
+void   benchsweep(char*, char*, benchfn, void*, int);
+int    benchselected(char*, char**, int);
+void   benchfail(char*) __attribute__((noreturn));
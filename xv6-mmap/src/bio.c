@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,47 +12,422 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To start reading a block that will be wanted soon, call
+//     breadahead; it does not wait for the disk.
+// * To write several buffers at once, call bawrite on each,
+//     then bwait and brelse on each.
 //
-// The implementation uses two state flags internally:
+// The implementation uses four state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+// * B_ASYNC: no process waits for the request; the disk
+//     driver calls bdone, which unlocks the buffer.
+// * B_RELSE: bdone releases the buffer as well.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "fs.h"
 #include "buf.h"
+#include "bstat.h"
+#include "trace.h"
 
-struct {
+extern char end[]; // first address after kernel loaded from ELF file
+
+// Buffers are hashed by (dev, blockno) into NBUCKET chains, each
+// with its own lock, so lookups are O(1) and lookups of
+// different blocks from different CPUs do not contend.  A
+// bucket's lock covers its chain, the refcnt of the buffers
+// on it, and its hit and miss counts.  Unreferenced buffers
+// are also on one of two lists, under lrulock, from which a
+// miss takes a clean one to recycle.  Locks are acquired in
+// the order bucket lock, lrulock; never two bucket locks at
+// once.
+//
+// Which list, and which buffer is recycled, depends on the
+// replacement policy:
+//
+// BC_LRU: released buffers go on am, and the least recently
+// used is recycled.  One pass over a file larger than the
+// cache flushes everything else out of it.
+//
+// BC_2Q (the default): 2Q, after Johnson and Shasha.  A block
+// read into the cache goes on a1 when released, and stays on
+// a1 however often it is used while cached; uses close
+// together are usually one read or one operation.  Once a1
+// holds more than a quarter of the buffers it is recycled
+// first, so a sequential scan passes through a1 and leaves am
+// alone.  The last buffers recycled from a1 are remembered in
+// a ghost list; a miss on a remembered block means the block
+// was wanted again after a while, and it goes on am, which is
+// LRU.  Inode, bitmap and directory blocks so end up on am and
+// stay cached while large files stream through.
+//
+// Buffers come from a slab cache.  binit allocates NBUF of
+// them; after that a miss allocates a new buffer rather than
+// recycling one, until there are maxbuf, set at boot to use
+// at most 1/BCACHEDIV of physical memory.  When kalloc runs
+// out it calls breclaim, which gives unreferenced clean
+// buffers back, down to NBUF again.
+#define NBUCKET 61
+#define BUCKET(dev, blockno) (&bcache.bucket[((dev)*31 + (blockno)) % NBUCKET])
+
+#define BCACHEDIV  8    // buffers may use 1/BCACHEDIV of memory
+#define NRECLAIM   64   // buffers breclaim frees per call
+#define NGHOST     512  // most blocks the ghost list remembers
+#define NODEV      (~0U)
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;  // linked through hnext
+  uint64 hits;
+  uint64 misses;
+  uint64 readaheads;
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+struct ghost {
+  uint dev;
+  uint blockno;
+};
+
+struct {
+  struct slabcache cache;
+  struct bucket bucket[NBUCKET];
+
+  // Unreferenced buffers, through prev/next: on am if b->hot,
+  // else on a1.  The next of each is the most recently used.
+  struct spinlock lrulock;
+  struct buf a1;
+  struct buf am;
+
+  // Protected by lrulock.
+  int policy;
+  uint na1;          // buffers on a1
+  uint nbuf;         // buffers allocated, or being allocated
+  uint maxbuf;
+  uint limit;        // most maxbuf may be set to
+  struct ghost ghost[NGHOST];  // ring, newest before ghostnext
+  uint ghostnext;
+  uint64 evicts;
+  uint64 grows;
+  uint64 shrinks;
+  uint64 waits;
+  uint64 ghosthits;
 } bcache;
 
+// Allocate a buffer, unhashed and unreferenced, or return 0.
+static struct buf*
+newbuf(void)
+{
+  struct buf *b;
+
+  if((b = slaballoc(&bcache.cache)) == 0)
+    return 0;
+  memset(b, 0, sizeof(*b));
+  initsleeplock(&b->lock, "buffer");
+  return b;
+}
+
+// Take b off its list.  Caller holds lrulock.
+static void
+lruremove(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  b->next = b->prev = 0;
+  if(!b->hot)
+    bcache.na1--;
+}
+
+// Put b on its list, at the most recently used end, or the
+// least if old.  Caller holds lrulock.
+static void
+lruinsert(struct buf *b, int old)
+{
+  struct buf *at;
+
+  at = b->hot ? &bcache.am : &bcache.a1;
+  if(old)
+    at = at->prev;
+  b->next = at->next;
+  b->prev = at;
+  at->next->prev = b;
+  at->next = b;
+  if(!b->hot)
+    bcache.na1++;
+}
+
+// Remember that (dev, blockno) was recycled from a1.
+// Caller holds lrulock.
+static void
+remember(uint dev, uint blockno)
+{
+  struct ghost *g;
+
+  g = &bcache.ghost[bcache.ghostnext++ % NGHOST];
+  g->dev = dev;
+  g->blockno = blockno;
+}
+
+// Was (dev, blockno) recycled from a1 recently enough to be
+// remembered?  As in 2Q, the ghost list covers the last half
+// a cache's worth of such blocks.  Caller holds lrulock.
+static int
+forget(uint dev, uint blockno)
+{
+  struct ghost *g;
+  uint i, n;
+
+  n = bcache.nbuf / 2;
+  if(n > NGHOST)
+    n = NGHOST;
+  for(i = 1; i <= n; i++){
+    g = &bcache.ghost[(bcache.ghostnext - i) % NGHOST];
+    if(g->dev == dev && g->blockno == blockno){
+      g->dev = NODEV;
+      bcache.ghosthits++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  int i;
 
-  initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache");
+  initmcslock(&bcache.lrulock, "bcachelru");
+  slabinit(&bcache.cache, "bufcache", sizeof(struct buf));
+
+  // binit runs before kinit2 has freed most of memory, so
+  // size the cache from what there will be.
+  bcache.limit = (PHYSTOP - V2P(end)) / BCACHEDIV / sizeof(struct buf);
+  if(bcache.limit < NBUF)
+    bcache.limit = NBUF;
+  bcache.maxbuf = bcache.limit;
+  bcache.policy = BC_2Q;
+  for(i = 0; i < NGHOST; i++)
+    bcache.ghost[i].dev = NODEV;
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // All buffers start out unhashed and on a1.
+  bcache.a1.prev = bcache.a1.next = &bcache.a1;
+  bcache.am.prev = bcache.am.next = &bcache.am;
+  for(i = 0; i < NBUF; i++){
+    if((b = newbuf()) == 0)
+      panic("binit");
+    lruinsert(b, 0);
+  }
+  bcache.nbuf = NBUF;
+}
+
+// Return the buffer for (dev, blockno) on bk, or 0.
+// Caller holds bk->lock.
+static struct buf*
+lookup(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b != 0; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// Caller holds bk->lock.
+static void
+unhash(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+    ;
+  *pp = b->hnext;
+  b->hnext = 0;
+  b->hashed = 0;
+}
+
+// Return the least recently used clean buffer on list l, or 0.
+static struct buf*
+oldest(struct buf *l)
+{
+  struct buf *b;
+
+  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+  // because log.c has modified it but not yet committed it.
+  for(b = l->prev; b != l; b = b->prev)
+    if((b->flags & B_DIRTY) == 0)
+      return b;
+  return 0;
+}
+
+// Choose the buffer to recycle next, by the policy, or 0.
+// Under BC_LRU, a1 holds only buffers left from BC_2Q and
+// goes first.  Caller holds lrulock.
+static struct buf*
+victim(void)
+{
+  struct buf *first, *second, *b;
+
+  first = &bcache.a1;
+  second = &bcache.am;
+  if(bcache.policy == BC_2Q && bcache.na1 <= bcache.nbuf/4){
+    first = &bcache.am;
+    second = &bcache.a1;
+  }
+  if((b = oldest(first)) == 0)
+    b = oldest(second);
+  return b;
+}
+
+// Claim a clean unreferenced buffer, chosen by victim, and
+// take it off its hash chain.  Returns it off its list,
+// unhashed and with refcnt 0, so it belongs to the caller; or
+// 0 if there is none.  Caller holds lrulock, which claim may
+// release and reacquire.
+static struct buf*
+claim(void)
+{
+  struct bucket *bk;
+  struct buf *b;
+  uint dev, blockno;
+
+  for(;;){
+    if((b = victim()) == 0)
+      return 0;
+    // No lookup can find an unhashed buffer, so lrulock is
+    // enough to take it.
+    if(!b->hashed){
+      lruremove(b);
+      return b;
+    }
+
+    // Taking a hashed buffer needs its bucket lock too, which
+    // comes first.  With both dropped, a lookup may take b and
+    // release it again, or another claim may recycle it; so
+    // take b only if it is still cached as (dev, blockno),
+    // unreferenced, clean, and on a list.
+    dev = b->dev;
+    blockno = b->blockno;
+    release(&bcache.lrulock);
+    bk = BUCKET(dev, blockno);
+    acquire(&bk->lock);
+    acquire(&bcache.lrulock);
+    if(lookup(bk, dev, blockno) == b && b->refcnt == 0 && b->next != 0 &&
+       (b->flags & B_DIRTY) == 0){
+      lruremove(b);
+      unhash(bk, b);
+      release(&bk->lock);
+      bcache.evicts++;
+      if(!b->hot && bcache.policy == BC_2Q)
+        remember(dev, blockno);
+      return b;
+    }
+    release(&bk->lock);
+  }
+}
+
+// Return a buffer for a miss on (dev, blockno): a new one
+// while the cache may grow, else a recycled one.  Waits if
+// every buffer is in use, until brelse returns one.  Sets
+// b->hot to say which list b goes on when released.
+static struct buf*
+recycle(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  acquire(&bcache.lrulock);
+  for(;;){
+    if(bcache.nbuf < bcache.maxbuf){
+      bcache.nbuf++;
+      release(&bcache.lrulock);
+      b = newbuf();
+      acquire(&bcache.lrulock);
+      if(b != 0){
+        bcache.grows++;
+        break;
+      }
+      bcache.nbuf--;
+    }
+    if((b = claim()) != 0)
+      break;
+    bcache.waits++;
+    sleep(&bcache, &bcache.lrulock);
+  }
+  b->hot = bcache.policy == BC_LRU || forget(dev, blockno);
+  release(&bcache.lrulock);
+  return b;
+}
+
+// Free clean unreferenced buffers, at most n, until there are
+// only target.  Caller holds lrulock, which shrink may release
+// and reacquire.  Returns the number freed.
+static int
+shrink(uint target, int n)
+{
+  struct buf *b;
+  int i;
+
+  for(i = 0; i < n && bcache.nbuf > target; i++){
+    if((b = claim()) == 0)
+      break;
+    bcache.nbuf--;
+    bcache.shrinks++;
+    release(&bcache.lrulock);
+    slabfree(&bcache.cache, b);
+    acquire(&bcache.lrulock);
+  }
+  return i;
+}
+
+// Give up to NRECLAIM unreferenced clean buffers back to the
+// slab cache, and so pages back to kalloc, keeping at least
+// NBUF.  Called by kalloc when it runs out.  Returns the
+// number freed.
+int
+breclaim(void)
+{
+  int n;
+
+  // Not while allocating a buffer: the slab cache is locked.
+  if(holding(&bcache.cache.lock))
+    return 0;
+  acquire(&bcache.lrulock);
+  n = shrink(NBUF, NRECLAIM);
+  release(&bcache.lrulock);
+  return n;
+}
+
+// Set the replacement policy, unless policy is -1, and the
+// most buffers the cache may hold, unless maxbuf is -1,
+// freeing buffers above a lower limit.  Returns 0, or -1 if
+// either is out of range.
+int
+bcachectl(int policy, int maxbuf)
+{
+  if(policy < -1 || policy > BC_2Q)
+    return -1;
+  if(maxbuf != -1 && (maxbuf < NBUF || maxbuf > bcache.limit))
+    return -1;
+  acquire(&bcache.lrulock);
+  if(policy != -1)
+    bcache.policy = policy;
+  if(maxbuf != -1){
+    bcache.maxbuf = maxbuf;
+    shrink(maxbuf, bcache.nbuf);
+    wakeup(&bcache);
   }
+  release(&bcache.lrulock);
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -61,35 +436,83 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct bucket *bk;
+  struct buf *b, *nb;
 
-  acquire(&bcache.lock);
+  bk = BUCKET(dev, blockno);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  if((b = lookup(bk, dev, blockno)) != 0){
+    bk->hits++;
+    if(b->refcnt++ == 0){
+      acquire(&bcache.lrulock);
+      if(b->next)
+        lruremove(b);
+      release(&bcache.lrulock);
     }
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  bk->misses++;
+  release(&bk->lock);
 
   // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  trace(TR_BMISS, blockno);
+  nb = recycle(dev, blockno);
+  acquire(&bk->lock);
+  if((b = lookup(bk, dev, blockno)) != 0){
+    // Another miss cached it meanwhile; use that one, and put
+    // nb back to be recycled first.
+    acquire(&bcache.lrulock);
+    if(b->refcnt++ == 0 && b->next)
+      lruremove(b);
+    nb->hot = 0;
+    lruinsert(nb, 1);
+    wakeup(&bcache);
+    release(&bcache.lrulock);
+  } else {
+    b = nb;
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->refcnt = 1;
+    b->hnext = bk->head;
+    bk->head = b;
+    b->hashed = 1;
   }
-  panic("bget: no buffers");
+  release(&bk->lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Copy the cache's statistics to st.
+void
+bstat(struct bstat *st)
+{
+  struct bucket *bk;
+
+  memset(st, 0, sizeof(*st));
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++){
+    acquire(&bk->lock);
+    st->hits += bk->hits;
+    st->misses += bk->misses;
+    st->readaheads += bk->readaheads;
+    release(&bk->lock);
+  }
+  acquire(&bcache.lrulock);
+  st->nbuf = bcache.nbuf;
+  st->minbuf = NBUF;
+  st->maxbuf = bcache.maxbuf;
+  st->policy = bcache.policy;
+  st->na1 = bcache.na1;
+  st->evicts = bcache.evicts;
+  st->grows = bcache.grows;
+  st->shrinks = bcache.shrinks;
+  st->waits = bcache.waits;
+  st->ghosthits = bcache.ghosthits;
+  release(&bcache.lrulock);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -105,6 +528,34 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Start reading block blockno into the cache, unless it is
+// cached already, and return without waiting for the disk.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct bucket *bk;
+  struct buf *b;
+
+  bk = BUCKET(dev, blockno);
+  acquire(&bk->lock);
+  b = lookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b != 0)
+    return;
+
+  b = bget(dev, blockno);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  acquire(&bk->lock);
+  bk->readaheads++;
+  release(&bk->lock);
+  b->flags |= B_ASYNC|B_RELSE;
+  disownsleep(&b->lock);
+  iderw(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,30 +566,73 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
-// Release a locked buffer.
-// Move to the head of the MRU list.
+// Start writing b's contents to disk and return without
+// waiting.  Must be locked.  b's lock passes to the disk until
+// the write is done, but the caller keeps its reference and
+// must call bwait before using or releasing b.
 void
-brelse(struct buf *b)
+bawrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
-    panic("brelse");
+    panic("bawrite");
+  b->flags |= B_DIRTY|B_ASYNC;
+  disownsleep(&b->lock);
+  iderw(b);
+}
 
-  releasesleep(&b->lock);
+// Wait for bawrite(b) to finish, and lock b again.
+void
+bwait(struct buf *b)
+{
+  acquiresleep(&b->lock);
+}
 
-  acquire(&bcache.lock);
+// Drop a reference to b, which is unlocked.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = BUCKET(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    acquire(&bcache.lrulock);
+    if(bcache.policy == BC_LRU)
+      b->hot = 1;
+    lruinsert(b, 0);
+    wakeup(&bcache);
+    release(&bcache.lrulock);
   }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
+}
+
+// Release a locked buffer.
+// Move to the most recently used end of its list.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Called by the disk driver, maybe from an interrupt, when a
+// B_ASYNC request for b has finished: unlock b, and release it
+// if B_RELSE, on behalf of the process that started it.
+void
+bdone(struct buf *b)
+{
+  int relse;
+
+  relse = b->flags & B_RELSE;
+  b->flags &= ~(B_ASYNC|B_RELSE);
+  releasesleep(&b->lock);
+  if(relse)
+    bput(b);
 }
 //PAGEBREAK!
 // Blank page.
-
@@ -0,0 +1,82 @@
+// Print buffer cache and disk statistics.
+//
+//   bstat              print the counters
+//   bstat command ...  run command, print how the counters
+//                      changed while it ran
+//
+// Prints the replacement policy, buffers allocated (with the
+// limits) and unreferenced buffers on a1, hits, misses, hit
+// rate in tenths of a percent, evictions, buffers grown and
+// shrunk, waits for a free buffer, misses on blocks in the
+// ghost list (see bio.c), and reads started ahead of use.
+// Then, for the disk: DMA or PIO, commands, sectors moved,
+// and CPU cycles the driver spent, in all and per megabyte.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "bstat.h"
+
+void
+print(struct bstat *st)
+{
+  uint64 n;
+
+  n = st->hits + st->misses;
+  printf(1, "policy=%s nbuf=%d min=%d max=%d a1=%d hits=%l misses=%l hitpermille=%l evicts=%l grows=%l shrinks=%l waits=%l ghosthits=%l readaheads=%l\n",
+         st->policy == BC_2Q ? "2q" : "lru",
+         st->nbuf, st->minbuf, st->maxbuf, st->na1, st->hits, st->misses,
+         n ? udiv64(st->hits * 1000, n) : 0,
+         st->evicts, st->grows, st->shrinks, st->waits, st->ghosthits,
+         st->readaheads);
+}
+
+void
+dprint(struct dstat *st)
+{
+  printf(1, "disk mode=%s cmds=%l sectors=%l cycles=%l cyclespermb=%l\n",
+         st->dma ? "dma" : "pio", st->cmds, st->sectors, st->cycles,
+         st->sectors ? udiv64(st->cycles * 2048, st->sectors) : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bstat st0, st;
+  struct dstat d0, d;
+  int pid;
+
+  if(bstat(&st0) < 0 || dstat(&d0) < 0){
+    printf(2, "bstat: failed\n");
+    exit();
+  }
+  if(argc < 2){
+    print(&st0);
+    dprint(&d0);
+    exit();
+  }
+
+  if((pid = fork()) == 0){
+    exec(argv[1], argv+1);
+    printf(2, "bstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  if(pid > 0)
+    wait();
+  bstat(&st);
+  dstat(&d);
+  st.hits -= st0.hits;
+  st.misses -= st0.misses;
+  st.evicts -= st0.evicts;
+  st.grows -= st0.grows;
+  st.shrinks -= st0.shrinks;
+  st.waits -= st0.waits;
+  st.ghosthits -= st0.ghosthits;
+  st.readaheads -= st0.readaheads;
+  print(&st);
+  d.cmds -= d0.cmds;
+  d.sectors -= d0.sectors;
+  d.cycles -= d0.cycles;
+  dprint(&d);
+  exit();
+}
@@ -0,0 +1,31 @@
+// Buffer cache statistics, returned by the bstat system call,
+// and the replacement policies bcachectl can select.
+
+#define BC_LRU  0   // recycle the least recently used buffer
+#define BC_2Q   1   // 2Q, which resists sequential scans (see bio.c)
+
+struct bstat {
+  uint nbuf;            // buffers now allocated
+  uint minbuf;          // the cache never shrinks below this
+  uint maxbuf;          // or grows above this
+  int policy;           // BC_LRU or BC_2Q
+  uint na1;             // unreferenced buffers used only once
+  uint64 hits;          // lookups that found the block cached
+  uint64 misses;        // lookups that did not
+  uint64 readaheads;    // misses that started a read and did not wait
+  uint64 evicts;        // misses that recycled another block's buffer
+  uint64 grows;         // misses that allocated a new buffer
+  uint64 shrinks;       // buffers given back to kalloc
+  uint64 waits;         // times a miss found no free buffer and slept
+  uint64 ghosthits;     // misses on a block recently recycled from a1
+};
+
+// Disk driver statistics, returned by the dstat system call.
+
+struct dstat {
+  int dma;              // 1 if the disk uses bus-master DMA, 0 for PIO
+  uint64 cmds;          // commands sent to the disk
+  uint64 sectors;       // sectors read or written
+  uint64 cycles;        // CPU cycles spent starting commands and
+                        // handling their interrupts
+};
@@ -3,12 +3,17 @@ struct buf {
   uint dev;
   uint blockno;
   struct sleeplock lock;
-  uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint refcnt;       // protected by the hash bucket's lock
+  struct buf *prev; // list of unreferenced buffers, or 0
   struct buf *next;
+  struct buf *hnext; // hash chain
+  int hashed;        // on a hash chain?
+  int hot;           // on bcache.am rather than a1 (see bio.c)
   struct buf *qnext; // disk queue
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // driver calls bdone when the request finishes
+#define B_RELSE 0x10 // bdone releases the buffer too
 
@@ -1,19 +1,38 @@
+struct bstat;
+struct dstat;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct mm;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct rwspinlock;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct timer;
+struct traceent;
+struct lockstat;
+struct lockclass;
+struct profsample;
+struct pinfo;
+struct trapframe;
 
 // bio.c
+void            bawrite(struct buf*);
+int             bcachectl(int, int);
+void            bdone(struct buf*);
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breadahead(uint, uint);
+int             breclaim(void);
 void            brelse(struct buf*);
+void            bstat(struct bstat*);
+void            bwait(struct buf*);
 void            bwrite(struct buf*);
 
 // console.c
@@ -31,6 +50,7 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             fileseek(struct file*, int, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
@@ -42,7 +62,9 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
+void            ireadahead(struct inode*, uint, uint);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
@@ -53,10 +75,16 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idestat(struct dstat*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -73,6 +101,7 @@ void            kinit2(void*, void*);
 void            kbdintr(void);
 
 // kmalloc.c
+void            kmallocinit(void);
 void*           kmalloc(uint);
 void            kmfree(void*);
 
@@ -83,6 +112,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapicipi(int, int);
 void            microdelay(int);
 
 // log.c
@@ -94,12 +124,18 @@ void            end_op();
 //  mmap.c
 void*           mmap(void *, uint, int, int, int, int);
 int             munmap(void *, uint);
-void            free_mmap_ll(void);
+void            free_mmap_ll(struct mm*);
+int             dup_mmap_ll(struct mm*, struct mm*);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pci.c
+int             pcifind(uint, uint*);
+uint            pciread(uint, int);
+void            pciwrite(uint, int, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -111,41 +147,75 @@ int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
+// prof.c
+void            profinit(void);
+void            profsample(struct trapframe*);
+int             profctl(int);
+int             profread(struct profsample*, int);
+
 // proc.c
+int             clone(void(*)(void*), void*, void*);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             getpinfo(struct pinfo*, int);
 int             growproc(int);
+int             join(void**);
 int             kill(int);
+struct mm*      mmalloc(void);
+void            mmput(struct mm*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+int             nice(int, int);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+void            sleepexcl(void*, struct spinlock*);
+int             timeslice(void);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// slab.c
+void            slabinit(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initmcslock(struct spinlock*, char*);
+void            initrwlock(struct rwspinlock*, char*);
+void            acquireread(struct rwspinlock*);
+void            releaseread(struct rwspinlock*);
+void            acquirewrite(struct rwspinlock*);
+void            releasewrite(struct rwspinlock*);
+int             holdingwrite(struct rwspinlock*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+int             lockstat(struct lockstat*, int, int);
+struct lockclass* lockclassof(char*);
+void            lockacquired(struct lockclass*, int, int, uint64);
+void            lockreleased(struct lockclass*, uint64);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            disownsleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+int             lockedsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -166,7 +236,9 @@ int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
-void            timerinit(void);
+void            timeradd(struct timer*);
+void            timerdel(struct timer*);
+void            timertick(void);
 
 // trap.c
 void            idtinit(void);
@@ -174,6 +246,12 @@ extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
+// trace.c
+void            traceinit(void);
+void            trace(int, uint);
+int             tracectl(int);
+int             traceread(struct traceent*, int);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
@@ -186,6 +264,8 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             shrinkuvm(struct proc*, uint, uint);
+int             sinkfault(struct proc*, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
@@ -194,6 +274,8 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+void            tlbshootdown(struct mm*);
+void            tlbflushintr(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
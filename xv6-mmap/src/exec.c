@@ -2,7 +2,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
@@ -16,17 +19,22 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  pde_t *pgdir;
+  struct mm *mm, *oldmm;
   struct proc *curproc = myproc();
 
+  if((mm = mmalloc()) == 0)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
+    mmput(mm);
     cprintf("exec: fail\n");
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);
   pgdir = 0;
 
   // Check ELF header
@@ -93,14 +101,17 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
+  // Commit to the user image.  The new image gets its own
+  // address space; other threads keep the old one.
+  mm->pgdir = pgdir;
+  mm->sz = sz;
+  oldmm = curproc->mm;
+  curproc->mm = mm;
+  curproc->ustack = 0;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
-  freevm(oldpgdir);
+  mmput(oldmm);
   return 0;
 
  bad:
@@ -110,5 +121,6 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  mmput(mm);
   return -1;
 }
@@ -6,9 +6,15 @@
 #include "defs.h"
 #include "param.h"
 #include "fs.h"
+#include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
+
+#define RAMIN 4   // first readahead window, in blocks
+#define RAMAX 32  // largest readahead window
 
 struct devsw devsw[NDEV];
 struct {
@@ -84,7 +90,7 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
     iunlock(f->ip);
     return 0;
@@ -92,7 +98,80 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
-// Read from file f.
+// Set the offset of file f relative to whence (SEEK_*).
+// The new offset must lie within the file, since writei
+// cannot leave holes.  Returns the new offset or -1.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int base;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(whence == SEEK_SET)
+    base = 0;
+  else if(whence == SEEK_CUR)
+    base = f->off;
+  else if(whence == SEEK_END)
+    base = f->ip->size;
+  else
+    base = -1;
+  if(base < 0 || base + off < 0 || base + off > f->ip->size){
+    iunlock(f->ip);
+    return -1;
+  }
+  f->off = base + off;
+  iunlock(f->ip);
+  return f->off;
+}
+
+// Might another thread use f's offset while we do?  Only
+// through another reference to f or another thread sharing
+// our file table, and only we can create either, so the
+// answer cannot change to yes during our read.
+static int
+offshared(struct file *f)
+{
+  return f->ref > 1 || myproc()->fdt->ref > 1;
+}
+
+// Start reading ahead for a read of n bytes at f->off.  A read
+// is sequential if it starts where the last one ended, or at
+// the start of a newly opened file.  Sequential reads keep
+// requests in flight for the blocks up to a window past the
+// end of the current read; once the reader gets within half a
+// window of rablock, another window is started, twice as big
+// as the last, up to RAMAX.  The current read's own blocks are
+// started too, so they queue at the disk together rather than
+// one at a time.  Caller holds f->ip's lock.
+static void
+readahead(struct file *f, int n)
+{
+  uint bn, end;
+
+  if(f->off != f->raoff || n <= 0){
+    f->rablock = f->rawin = 0;
+    return;
+  }
+  bn = f->off / BSIZE;
+  if(n > RAMAX*BSIZE)
+    n = RAMAX*BSIZE;
+  end = (f->off + n + BSIZE-1) / BSIZE;
+  if(f->rablock < bn)
+    f->rablock = bn;
+  if(f->rawin > 0 && f->rablock >= end + f->rawin/2)
+    return;
+  if(f->rawin == 0)
+    f->rawin = RAMIN;
+  else if(f->rawin < RAMAX)
+    f->rawin *= 2;
+  ireadahead(f->ip, f->rablock, end + f->rawin - f->rablock);
+  f->rablock = end + f->rawin;
+}
+
+// Read from file f.  Readers with their own offsets share the
+// inode lock, so they can read the same file at once.
 int
 fileread(struct file *f, char *addr, int n)
 {
@@ -103,9 +182,14 @@ fileread(struct file *f, char *addr, int n)
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    if(offshared(f))
+      ilock(f->ip);
+    else
+      ilockshared(f->ip);
+    readahead(f, n);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
+    f->raoff = f->off;
     iunlock(f->ip);
     return r;
   }
@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint raoff;   // where a sequential read would start
+  uint rablock; // first block not yet read ahead
+  uint rawin;   // readahead window in blocks, 0 if not sequential
 };
 
 
@@ -1,11 +1,12 @@
 // Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// The number of processes is limited only by memory, so
+// N is large enough that fork must run out of it.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 
-#define N  1000
+#define N  100000
 
 void
 printf(int fd, const char *s, ...)
@@ -14,8 +14,8 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -159,13 +159,19 @@ bfree(int dev, uint b)
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// It is a reader-writer lock: lookups that find the inode cached
+// hold it for reading and increment ip->ref atomically, while
+// changes that can drop ip->ref or recycle an entry hold it for
+// writing.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+// ilockshared() takes it shared, for readers that only read
+// those fields and the inode's contents.
 
 struct {
-  struct spinlock lock;
+  struct rwspinlock lock;
   struct inode inode[NINODE];
 } icache;
 
@@ -174,7 +180,7 @@ iinit(int dev)
 {
   int i = 0;
   
-  initlock(&icache.lock, "icache");
+  initrwlock(&icache.lock, "icache");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
   }
@@ -244,14 +250,26 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&icache.lock);
+  // Is the inode already cached?  Readers cannot drop a ref,
+  // so a cached entry stays put while we take one.
+  acquireread(&icache.lock);
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      __sync_fetch_and_add(&ip->ref, 1);
+      releaseread(&icache.lock);
+      return ip;
+    }
+  }
+  releaseread(&icache.lock);
 
-  // Is the inode already cached?
+  // Look again with the lock held for writing, since another
+  // CPU may have cached it meanwhile.
+  acquirewrite(&icache.lock);
   empty = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&icache.lock);
+      releasewrite(&icache.lock);
       return ip;
     }
     if(empty == 0 && ip->ref == 0)    // Remember empty slot.
@@ -267,7 +285,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&icache.lock);
+  releasewrite(&icache.lock);
 
   return ip;
 }
@@ -277,25 +295,20 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  acquireread(&icache.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
+  releaseread(&icache.lock);
   return ip;
 }
 
-// Lock the given inode.
-// Reads the inode from disk if necessary.
-void
-ilock(struct inode *ip)
+// Read ip from disk if it is not yet valid.  Caller holds
+// ip->lock exclusively.
+static void
+iload(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
 
-  if(ip == 0 || ip->ref < 1)
-    panic("ilock");
-
-  acquiresleep(&ip->lock);
-
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
@@ -312,11 +325,41 @@ ilock(struct inode *ip)
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode.
+// Reads the inode from disk if necessary.
+void
+ilock(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilock");
+
+  acquiresleep(&ip->lock);
+  iload(ip);
+}
+
+// Lock the given inode shared with other readers, for callers
+// that only read it (readi, dirlookup, stati).  Reads the inode
+// from disk if necessary, which needs the lock exclusively.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(ip->valid == 0){
+    releasesleep(&ip->lock);
+    ilock(ip);
+    releasesleep(&ip->lock);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// Unlock the given inode, locked either way.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || !lockedsleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
   releasesleep(&ip->lock);
@@ -334,9 +377,9 @@ iput(struct inode *ip)
 {
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
+    acquirewrite(&icache.lock);
     int r = ip->ref;
-    release(&icache.lock);
+    releasewrite(&icache.lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
@@ -347,9 +390,9 @@ iput(struct inode *ip)
   }
   releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
+  acquirewrite(&icache.lock);
   ip->ref--;
-  release(&icache.lock);
+  releasewrite(&icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -447,6 +490,19 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Start reading data blocks bn..bn+n-1 of ip into the buffer
+// cache, stopping at the end of the file, without waiting.
+// Caller must hold ip->lock, shared or exclusive; the blocks
+// exist, since files have no holes, so bmap only reads.
+void
+ireadahead(struct inode *ip, uint bn, uint n)
+{
+  if(ip->type == T_DEV)
+    return;
+  for(; n > 0 && bn < MAXFILE && bn*BSIZE < ip->size; bn++, n--)
+    breadahead(ip->dev, bmap(ip, bn));
+}
+
 //PAGEBREAK!
 // Read data from inode.
 // Caller must hold ip->lock.
@@ -633,7 +689,7 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -0,0 +1,563 @@
+// File system benchmarks.
+//
+//   fsbench [-p maxproc] [-n iters] [test ...]
+//
+// Tests (default all):
+//   seqwrite   write a file SEQSIZE bytes at a time
+//   seqread    read a file SEQSIZE bytes at a time
+//   randwrite  overwrite random blocks of a file
+//   randread   read random blocks of a file
+//   create     create empty files in a large directory
+//   unlink     remove files from a large directory
+//   mkdir      create directories in a large directory
+//   small      create, write, read back and remove a small file
+//   scan       buffer cache hit rate on a few small files, each
+//              read between reads of a file larger than the
+//              cache, under each replacement policy
+//
+// Each process uses its own files, so runs with more processes
+// show concurrent writers and readers contending for the log,
+// the buffer cache and the disk; the directory tests share one
+// directory, which starts with DIRSIZE entries.  Each test runs
+// with 1, 2, 4, ... maxproc (default 8) processes doing iters
+// (default 64) operations each and prints one line per
+// configuration (see bench.h).  scan runs in one process with
+// the cache limited to SCANBUF buffers, iters rounds per
+// policy, and prints the hits and misses of the small files'
+// reads.  seqwrite, seqread and scan also print what the disk
+// driver did meanwhile: DMA or PIO, commands and sectors, and
+// the CPU cycles it spent per megabyte moved.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "bstat.h"
+#include "x86.h"
+#include "bench.h"
+
+#define SEQSIZE   4096        // bytes per sequential read or write
+#define FILESIZE  (64*1024)   // size of each process's data file
+#define SMALLSIZE 1024        // size of a small file
+#define DIRSIZE   256         // entries in the directory beforehand
+#define SCANBUF   96          // buffer cache size during scan
+#define NHOT      8           // small files read in each scan round
+#define DIR       "fsbdir"
+
+int iters = 64;
+char buf[SEQSIZE];
+
+// Return "fsb" + tag + id, e.g. fsbs3.
+char*
+filename(char *name, char *tag, int id)
+{
+  int n;
+
+  strcpy(name, "fsb");
+  strcpy(name+3, tag);
+  n = strlen(name);
+  name[n] = '0' + id;
+  name[n+1] = 0;
+  return name;
+}
+
+// Return DIR/<tag><id>.<k>, the kth entry of process id.
+char*
+entryname(char *name, char *tag, int id, int k)
+{
+  char *p;
+
+  strcpy(name, DIR "/");
+  p = name + strlen(name);
+  *p++ = tag[0];
+  *p++ = '0' + id;
+  *p++ = '.';
+  *p++ = '0' + k/100%10;
+  *p++ = '0' + k/10%10;
+  *p++ = '0' + k%10;
+  *p = 0;
+  return name;
+}
+
+uint
+random(uint *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+int
+makefile(char *name, int size)
+{
+  int fd, n;
+
+  unlink(name);
+  if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+    return -1;
+  for(n = 0; n < size; n += SEQSIZE)
+    if(write(fd, buf, SEQSIZE) != SEQSIZE){
+      close(fd);
+      return -1;
+    }
+  close(fd);
+  return 0;
+}
+
+//
+// Data tests.
+//
+
+// Write the file from the start, SEQSIZE bytes per sample,
+// removing it and starting over (untimed) when it is full.
+void
+seqwrite(int id, uint *s, int n, void *arg)
+{
+  char name[16];
+  uint64 t0;
+  int i, fd, off;
+
+  filename(name, "s", id);
+  fd = -1;
+  off = FILESIZE;
+  for(i = 0; i < n; i++){
+    if(off == FILESIZE){
+      close(fd);
+      unlink(name);
+      if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+        benchfail("create");
+      off = 0;
+    }
+    t0 = rdtsc();
+    if(write(fd, buf, SEQSIZE) != SEQSIZE)
+      benchfail("write");
+    s[i] = rdtsc() - t0;
+    off += SEQSIZE;
+  }
+  close(fd);
+}
+
+void
+seqread(int id, uint *s, int n, void *arg)
+{
+  char name[16];
+  uint64 t0;
+  int i, fd;
+
+  if((fd = open(filename(name, "s", id), O_RDONLY)) < 0)
+    benchfail("open");
+  for(i = 0; i < n; i++){
+    if(i > 0 && i % (FILESIZE/SEQSIZE) == 0 && lseek(fd, 0, SEEK_SET) < 0)
+      benchfail("lseek");
+    t0 = rdtsc();
+    if(read(fd, buf, SEQSIZE) != SEQSIZE)
+      benchfail("read");
+    s[i] = rdtsc() - t0;
+  }
+  close(fd);
+}
+
+// One sample is a seek to a random block and a one-block
+// read or write (arg non-zero).
+void
+randio(int id, uint *s, int n, void *arg)
+{
+  char name[16];
+  uint seed;
+  uint64 t0;
+  int i, fd, off;
+
+  if((fd = open(filename(name, "s", id), arg ? O_RDWR : O_RDONLY)) < 0)
+    benchfail("open");
+  seed = id + 1;
+  for(i = 0; i < n; i++){
+    off = (random(&seed) % (FILESIZE/BSIZE)) * BSIZE;
+    t0 = rdtsc();
+    if(lseek(fd, off, SEEK_SET) != off)
+      benchfail("lseek");
+    if(arg){
+      if(write(fd, buf, BSIZE) != BSIZE)
+        benchfail("write");
+    } else {
+      if(read(fd, buf, BSIZE) != BSIZE)
+        benchfail("read");
+    }
+    s[i] = rdtsc() - t0;
+  }
+  close(fd);
+}
+
+//
+// Metadata tests.  Each timed phase is paired with an untimed
+// one that puts the directory back as it was.
+//
+
+void
+create(int id, uint *s, int n, void *arg)
+{
+  char name[32];
+  uint64 t0;
+  int i, fd;
+
+  for(i = 0; i < n; i++){
+    entryname(name, "c", id, i);
+    t0 = rdtsc();
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+      benchfail("create");
+    close(fd);
+    s[i] = rdtsc() - t0;
+  }
+  for(i = 0; i < n; i++)
+    unlink(entryname(name, "c", id, i));
+}
+
+void
+remove(int id, uint *s, int n, void *arg)
+{
+  char name[32];
+  uint64 t0;
+  int i, fd;
+
+  for(i = 0; i < n; i++){
+    if((fd = open(entryname(name, "u", id, i), O_CREATE|O_WRONLY)) < 0)
+      benchfail("create");
+    close(fd);
+  }
+  for(i = 0; i < n; i++){
+    entryname(name, "u", id, i);
+    t0 = rdtsc();
+    if(unlink(name) < 0)
+      benchfail("unlink");
+    s[i] = rdtsc() - t0;
+  }
+}
+
+void
+makedir(int id, uint *s, int n, void *arg)
+{
+  char name[32];
+  uint64 t0;
+  int i;
+
+  for(i = 0; i < n; i++){
+    entryname(name, "d", id, i);
+    t0 = rdtsc();
+    if(mkdir(name) < 0)
+      benchfail("mkdir");
+    s[i] = rdtsc() - t0;
+  }
+  for(i = 0; i < n; i++)
+    unlink(entryname(name, "d", id, i));
+}
+
+// Create, write, close, reopen, read, close and unlink a
+// SMALLSIZE file in the current directory.
+void
+smallfile(int id, uint *s, int n, void *arg)
+{
+  char name[16];
+  uint64 t0;
+  int i, fd;
+
+  filename(name, "f", id);
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+      benchfail("create");
+    if(write(fd, buf, SMALLSIZE) != SMALLSIZE)
+      benchfail("write");
+    close(fd);
+    if((fd = open(name, O_RDONLY)) < 0)
+      benchfail("open");
+    if(read(fd, buf, SMALLSIZE) != SMALLSIZE)
+      benchfail("read");
+    close(fd);
+    if(unlink(name) < 0)
+      benchfail("unlink");
+    s[i] = rdtsc() - t0;
+  }
+}
+
+// Read all of name, SEQSIZE bytes at a time.
+void
+readfile(char *name)
+{
+  int fd;
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    benchfail("open");
+  while(read(fd, buf, SEQSIZE) > 0)
+    ;
+  close(fd);
+}
+
+//
+// Setup and the list of tests.
+//
+
+// Print the disk driver's work since dstat returned d0.
+void
+diskreport(char *test, char *params, struct dstat *d0)
+{
+  struct dstat d;
+
+  if(dstat(&d) < 0)
+    benchfail("dstat");
+  d.cmds -= d0->cmds;
+  d.sectors -= d0->sectors;
+  d.cycles -= d0->cycles;
+  printf(1, "%s test=%s %s%sdisk=%s cmds=%l sectors=%l cyclespermb=%l\n",
+         benchname, test, params, *params ? " " : "", d.dma ? "dma" : "pio",
+         d.cmds, d.sectors,
+         d.sectors ? udiv64(d.cycles * 2048, d.sectors) : 0);
+}
+
+void
+makefiles(void)
+{
+  char name[16];
+  int i;
+
+  for(i = 0; i < benchmaxproc; i++)
+    if(makefile(filename(name, "s", i), FILESIZE) < 0)
+      benchfail("create");
+}
+
+void
+removefiles(void)
+{
+  char name[16];
+  int i;
+
+  for(i = 0; i < benchmaxproc; i++)
+    unlink(filename(name, "s", i));
+}
+
+// Fill DIR with DIRSIZE files so lookups have to scan.
+void
+makedirfiles(void)
+{
+  char name[32];
+  int i, fd;
+
+  mkdir(DIR);
+  for(i = 0; i < DIRSIZE; i++){
+    if((fd = open(entryname(name, "x", 0, i), O_CREATE|O_WRONLY)) < 0)
+      benchfail("create");
+    close(fd);
+  }
+}
+
+void
+removedirfiles(void)
+{
+  char name[32];
+  int i;
+
+  for(i = 0; i < DIRSIZE; i++)
+    unlink(entryname(name, "x", 0, i));
+  unlink(DIR);
+}
+
+void
+runseqwrite(void)
+{
+  char params[24];
+  struct dstat d0;
+
+  benchbytes = SEQSIZE;
+  benchparam(params, "size", SEQSIZE);
+  if(dstat(&d0) < 0)
+    benchfail("dstat");
+  benchsweep("seqwrite", params, seqwrite, 0, iters);
+  diskreport("seqwrite", params, &d0);
+  removefiles();
+}
+
+void
+runseqread(void)
+{
+  char params[24];
+  struct dstat d0;
+
+  makefiles();
+  benchbytes = SEQSIZE;
+  benchparam(params, "size", SEQSIZE);
+  if(dstat(&d0) < 0)
+    benchfail("dstat");
+  benchsweep("seqread", params, seqread, 0, iters);
+  diskreport("seqread", params, &d0);
+  removefiles();
+}
+
+void
+runrandwrite(void)
+{
+  char params[24];
+
+  makefiles();
+  benchbytes = BSIZE;
+  benchsweep("randwrite", benchparam(params, "size", BSIZE), randio, (void*)1, iters);
+  removefiles();
+}
+
+void
+runrandread(void)
+{
+  char params[24];
+
+  makefiles();
+  benchbytes = BSIZE;
+  benchsweep("randread", benchparam(params, "size", BSIZE), randio, 0, iters);
+  removefiles();
+}
+
+void
+runmeta(char *test, benchfn fn)
+{
+  char params[24];
+
+  makedirfiles();
+  benchbytes = 0;
+  benchsweep(test, benchparam(params, "dirsize", DIRSIZE), fn, 0, iters);
+  removedirfiles();
+}
+
+void
+runcreate(void)
+{
+  runmeta("create", create);
+}
+
+void
+rununlink(void)
+{
+  runmeta("unlink", remove);
+}
+
+void
+runmkdir(void)
+{
+  runmeta("mkdir", makedir);
+}
+
+void
+runsmall(void)
+{
+  char params[24];
+
+  benchbytes = SMALLSIZE;
+  benchsweep("small", benchparam(params, "size", SMALLSIZE), smallfile, 0, iters);
+}
+
+// Each round reads the FILESIZE file, larger than the cache,
+// then the NHOT one-block files.  Under LRU the big file
+// flushes the small files' data, inode and directory blocks
+// every round; a scan-resistant policy should keep them.
+void
+runscan(void)
+{
+  static char *policies[] = { [BC_LRU] "lru", [BC_2Q] "2q" };
+  struct bstat st, st0, st1;
+  struct dstat d0;
+  char name[16], params[16];
+  int policy, i, r, fd;
+  uint64 hits, misses;
+
+  if(bstat(&st) < 0)
+    benchfail("bstat");
+  if(makefile(filename(name, "s", 0), FILESIZE) < 0)
+    benchfail("create");
+  for(i = 0; i < NHOT; i++){
+    unlink(filename(name, "h", i));
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0 ||
+       write(fd, buf, BSIZE) != BSIZE)
+      benchfail("create");
+    close(fd);
+  }
+
+  for(policy = BC_LRU; policy <= BC_2Q; policy++){
+    if(bcachectl(policy, SCANBUF) < 0)
+      benchfail("bcachectl");
+    hits = misses = 0;
+    if(dstat(&d0) < 0)
+      benchfail("dstat");
+    for(r = 0; r < iters; r++){
+      readfile(filename(name, "s", 0));
+      bstat(&st0);
+      for(i = 0; i < NHOT; i++)
+        readfile(filename(name, "h", i));
+      bstat(&st1);
+      hits += st1.hits - st0.hits;
+      misses += st1.misses - st0.misses;
+    }
+    printf(1, "%s test=scan policy=%s nbuf=%d nhot=%d rounds=%d hits=%l misses=%l hitpermille=%l\n",
+           benchname, policies[policy], SCANBUF, NHOT, iters, hits, misses,
+           hits + misses ? udiv64(hits * 1000, hits + misses) : 0);
+    strcpy(params, "policy=");
+    strcpy(params+7, policies[policy]);
+    diskreport("scan", params, &d0);
+  }
+
+  bcachectl(st.policy, st.maxbuf);
+  unlink(filename(name, "s", 0));
+  for(i = 0; i < NHOT; i++)
+    unlink(filename(name, "h", i));
+}
+
+struct {
+  char *name;
+  void (*run)(void);
+} tests[] = {
+  { "seqwrite",  runseqwrite },
+  { "seqread",   runseqread },
+  { "randwrite", runrandwrite },
+  { "randread",  runrandread },
+  { "create",    runcreate },
+  { "unlink",    rununlink },
+  { "mkdir",     runmkdir },
+  { "small",     runsmall },
+  { "scan",      runscan },
+};
+
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+void
+usage(void)
+{
+  printf(2, "usage: fsbench [-p maxproc] [-n iters] [test ...]\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n;
+
+  for(i = 1; i+1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-p") == 0)
+      benchmaxproc = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      iters = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(benchmaxproc < 1 || benchmaxproc > BENCHMAXPROC ||
+     iters < 1 || iters > 1000)
+    usage();
+  argv += i;
+  argc -= i;
+  for(i = 0; i < argc; i++){
+    n = 0;
+    for(j = 0; j < NTEST; j++)
+      n += benchselected(tests[j].name, &argv[i], 1);
+    if(n == 0)
+      usage();
+  }
+
+  benchinit("fsbench");
+  for(j = 0; j < NTEST; j++)
+    if(benchselected(tests[j].name, argv, argc))
+      tests[j].run();
+  exit();
+}
@@ -0,0 +1,105 @@
+// Futexes: the kernel half of user-space locks that enter
+// the kernel only to block or to wake a blocked waiter.
+//
+// A futex is an aligned word of user memory, named by the
+// kernel address of the physical word, so threads sharing an
+// mm or processes sharing a page find the same futex wherever
+// it is mapped.  Waiters sleep exclusively on that address,
+// using the existing wait queues, under a lock hashed from it
+// that futexwake also takes.  futexwait checks the word and
+// goes to sleep without dropping the lock, so a wake issued
+// after the word changes cannot be lost.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
+
+#define FUTEXBITS 6
+#define NFUTEX (1 << FUTEXBITS)
+#define FUTEXLOCK(key) (&futexlock[((uint)(key) * 2654435761U) >> (32 - FUTEXBITS)])
+
+static struct spinlock futexlock[NFUTEX];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEX; i++)
+    initlock(&futexlock[i], "futex");
+}
+
+// Return the key of the futex at user address uaddr in mm,
+// or 0 if uaddr is misaligned or not mapped.  Caller holds
+// mm->lock, so the page cannot be unmapped underneath it.
+static int*
+futexkey(struct mm *mm, uint uaddr)
+{
+  char *ka;
+
+  if(uaddr % sizeof(int) != 0 || uaddr >= KERNBASE)
+    return 0;
+  if((ka = uva2ka(mm->pgdir, (char*)PGROUNDDOWN(uaddr))) == 0)
+    return 0;
+  return (int*)(ka + uaddr % PGSIZE);
+}
+
+// If the futex at uaddr still holds val, sleep until a
+// futexwake on it.  Returns 0 after sleeping (possibly
+// spuriously), or -1 if the word differed or was not mapped.
+int
+futexwait(uint uaddr, int val)
+{
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  struct spinlock *lk;
+  int *key, cur;
+
+  acquiresleep(&mm->lock);
+  if((key = futexkey(mm, uaddr)) == 0){
+    releasesleep(&mm->lock);
+    return -1;
+  }
+  lk = FUTEXLOCK(key);
+  acquire(lk);
+  // Read the word while mm->lock keeps its page mapped; once
+  // lk is held, a futexwake after the change to it cannot be
+  // missed, so dropping mm->lock before sleeping is safe.
+  cur = *(volatile int*)key;
+  releasesleep(&mm->lock);
+  if(cur != val || p->killed){
+    release(lk);
+    return -1;
+  }
+  sleepexcl(key, lk);
+  release(lk);
+  return 0;
+}
+
+// Wake up to n waiters on the futex at uaddr.  Returns the
+// number woken, or -1 if uaddr was not mapped.
+int
+futexwake(uint uaddr, int n)
+{
+  struct mm *mm = myproc()->mm;
+  struct spinlock *lk;
+  int *key, woke;
+
+  acquiresleep(&mm->lock);
+  if((key = futexkey(mm, uaddr)) == 0){
+    releasesleep(&mm->lock);
+    return -1;
+  }
+  lk = FUTEXLOCK(key);
+  acquire(lk);
+  releasesleep(&mm->lock);
+  woke = wakeupn(key, n);
+  release(lk);
+  return woke;
+}
@@ -1,38 +1,91 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code: bus-master DMA on a PCI IDE controller that
+// supports it, PIO otherwise.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "bstat.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
 #define IDE_DF        0x20
+#define IDE_DRQ       0x08
 #define IDE_ERR       0x01
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMULT  0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+#define IDE_CMD_IDENTIFY 0xec
+
+#define IDE_MAXMULT   128  // most sectors per multiple command
+#define IDE_MAXDMA    128  // most sectors per DMA command
+
+// Bus-master IDE registers for the primary channel, at the
+// I/O base in BAR4 of the controller's PCI function.
+#define PCI_IDE       0x0101  // class and subclass of IDE controllers
+#define PCI_CMD       0x04
+#define PCI_CLASS     0x08
+#define PCI_BAR4      0x20
+#define BM_CMD        0      // command
+#define BM_STATUS     2
+#define BM_PRDT       4      // physical address of the PRD table
+#define BM_START      0x01   // BM_CMD: start transfer
+#define BM_TOMEM      0x08   // BM_CMD: device to memory
+#define BM_ERR        0x02   // BM_STATUS: transfer failed
+#define BM_INTR       0x04   // BM_STATUS: device interrupted
+#define BM_DMA01      0x60   // BM_STATUS: drives 0 and 1 set up for DMA
+
+// A physical region descriptor: one piece of memory for a DMA
+// transfer, which must not cross a 64K boundary.
+struct prd {
+  uint addr;
+  ushort count;   // bytes; 0 means 64K
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // last entry in the table
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+// One entry per buf in a batch, two if a buf's data crosses a
+// 64K boundary.  The table itself must not cross one either.
+static struct prd prdt[2*IDE_MAXDMA]
+  __attribute__((aligned(2*IDE_MAXDMA*sizeof(struct prd))));
+
+// idequeue holds the bufs waiting for the disk, sorted by
+// (dev, blockno) and linked through qnext.  ideactive is the
+// batch being read/written, in block order.  The disk works
+// through idequeue in one direction, C-SCAN: each batch
+// starts at the first request at or after (posdev, posblock),
+// where the last batch ended, wrapping around to the lowest
+// block when there is none.  A batch is a run of requests in
+// the same direction for consecutive blocks, moved by one
+// DMA or READ/WRITE MULTIPLE command with one interrupt.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static struct buf *ideactive;
+static int dmaactive;   // ideactive is moving by DMA
+static uint posdev, posblock;
+static struct dstat stats;
 
 static int havedisk1;
-static void idestart(struct buf*);
+static int idemult[2];  // sectors per multiple command, per drive, or 0
+static int idedma[2];   // drive can do multiword DMA?
+static ushort bmide;    // bus-master I/O base, or 0 for PIO only
+static void idestart(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -47,6 +100,60 @@ idewait(int checkerr)
   return 0;
 }
 
+// Ask drive d what it can do.  Put it in multiple mode with as
+// many sectors per interrupt as it allows, up to IDE_MAXMULT,
+// and record the count in idemult[d], or leave idemult[d] 0 if
+// the drive has no multiple mode.  Set idedma[d] if the drive
+// can do DMA.  Interrupts from the disk are off.
+static void
+ideidentify(int d)
+{
+  ushort id[SECTOR_SIZE/2];
+  int r, n;
+
+  outb(0x1f6, 0xe0 | (d<<4));
+  outb(0x1f7, IDE_CMD_IDENTIFY);
+  while((r = inb(0x1f7)) & IDE_BSY)
+    ;
+  if((r & (IDE_DF|IDE_ERR)) != 0 || (r & IDE_DRQ) == 0)
+    return;
+  insl(0x1f0, id, sizeof(id)/4);
+  idedma[d] = (id[49] & (1<<8)) != 0;
+
+  // Word 47 is the most sectors per interrupt; the count set
+  // must be a power of two.
+  for(n = IDE_MAXMULT; n > (id[47] & 0xff); n /= 2)
+    ;
+  if(n < 2)
+    return;
+  outb(0x1f2, n);
+  outb(0x1f7, IDE_CMD_SETMULT);
+  if(idewait(1) >= 0)
+    idemult[d] = n;
+}
+
+// Find the PCI IDE controller and, if it can be a bus master,
+// let it; then set bmide.  Leaves bmide 0 if there is no such
+// controller, as with an ISA-only disk.
+static void
+idedmainit(void)
+{
+  uint tag, bar;
+
+  if(pcifind(PCI_IDE, &tag) < 0)
+    return;
+  if((pciread(tag, PCI_CLASS) & (0x80<<8)) == 0)  // interface: bus master?
+    return;
+  bar = pciread(tag, PCI_BAR4);
+  if((bar & 1) == 0 || (bar & 0xfffc) == 0)
+    return;
+  pciwrite(tag, PCI_CMD, pciread(tag, PCI_CMD) | 0x5);  // I/O, bus master
+  bmide = bar & 0xfffc;
+  outb(bmide+BM_CMD, 0);
+  outb(bmide+BM_STATUS, BM_DMA01|BM_ERR|BM_INTR);
+  outl(bmide+BM_PRDT, V2P(prdt));
+}
+
 void
 ideinit(void)
 {
@@ -65,68 +172,215 @@ ideinit(void)
     }
   }
 
+  // Set up multiple mode with the disk's interrupts off;
+  // idestart turns them back on.
+  outb(0x3f6, 2);
+  ideidentify(0);
+  if(havedisk1)
+    ideidentify(1);
+  idedmainit();
+  stats.dma = bmide != 0 && (idedma[0] || idedma[1]);
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Does a come before b in (dev, blockno) order?
+static int
+before(uint adev, uint ablock, uint bdev, uint bblock)
+{
+  return adev < bdev || (adev == bdev && ablock < bblock);
+}
+
+// Insert b into idequeue in block order.
+// Caller must hold idelock.
 static void
-idestart(struct buf *b)
+idequeueadd(struct buf *b)
 {
-  if(b == 0)
+  struct buf **pp;
+
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+    if(!before((*pp)->dev, (*pp)->blockno, b->dev, b->blockno))
+      break;
+  b->qnext = *pp;
+  *pp = b;
+}
+
+// Point the PRD table at the data of the bufs in batch b.
+static void
+prdfill(struct buf *b)
+{
+  struct prd *p;
+  uint pa, n, len;
+
+  p = prdt;
+  for(; b; b = b->qnext){
+    for(pa = V2P(b->data), n = BSIZE; n > 0; pa += len, n -= len, p++){
+      len = 0x10000 - (pa & 0xffff);
+      if(len > n)
+        len = n;
+      p->addr = pa;
+      p->count = len;
+      p->flags = 0;
+    }
+  }
+  p[-1].flags = PRD_EOT;
+}
+
+// Take the next batch off idequeue and start it.
+// Caller must hold idelock.
+static void
+idestart(void)
+{
+  struct buf **pp, *b, *last;
+  int sector_per_block = BSIZE/SECTOR_SIZE;
+  int n, max, sector, nsector, read_cmd, write_cmd;
+  uint64 t0;
+
+  if(idequeue == 0 || ideactive != 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  t0 = rdtsc();
+  for(pp = &idequeue; *pp; pp = &(*pp)->qnext)
+    if(!before((*pp)->dev, (*pp)->blockno, posdev, posblock))
+      break;
+  if(*pp == 0)
+    pp = &idequeue;
+
+  b = *pp;
+  dmaactive = bmide != 0 && idedma[b->dev&1];
+  if(dmaactive)
+    max = IDE_MAXDMA / sector_per_block;
+  else
+    max = idemult[b->dev&1] / sector_per_block;
+  for(last = b, n = 1; n < max && last->qnext; last = last->qnext, n++)
+    if(last->qnext->dev != b->dev ||
+       last->qnext->blockno != last->blockno + 1 ||
+       (last->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+  *pp = last->qnext;
+  last->qnext = 0;
+  ideactive = b;
+  posdev = b->dev;
+  posblock = last->blockno + 1;
+
+  if(last->blockno >= FSSIZE)
     panic("incorrect blockno");
-  int sector_per_block =  BSIZE/SECTOR_SIZE;
-  int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  sector = b->blockno * sector_per_block;
+  nsector = n * sector_per_block;
+  if(dmaactive){
+    read_cmd = IDE_CMD_RDDMA;
+    write_cmd = IDE_CMD_WRDMA;
+  } else {
+    read_cmd = (nsector == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
+    write_cmd = (nsector == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  }
 
-  if (sector_per_block > 7) panic("idestart");
+  if (nsector > 255) panic("idestart");
 
+  if(dmaactive){
+    prdfill(b);
+    outb(bmide+BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_TOMEM);
+    outb(bmide+BM_STATUS, inb(bmide+BM_STATUS) | BM_ERR|BM_INTR);
+  }
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsector);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    if(!dmaactive)
+      for(; b; b = b->qnext)
+        outsl(0x1f0, b->data, BSIZE/4);
   } else {
     outb(0x1f7, read_cmd);
   }
+  if(dmaactive)
+    outb(bmide+BM_CMD, inb(bmide+BM_CMD) | BM_START);
+
+  stats.cmds++;
+  stats.sectors += nsector;
+  stats.cycles += rdtsc() - t0;
 }
 
 // Interrupt handler.
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *next, *done;
+  uint64 t0;
+  int st;
 
-  // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if((b = ideactive) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
+  t0 = rdtsc();
+  ideactive = 0;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(dmaactive){
+    // Stop the controller and acknowledge its interrupt.  If
+    // the transfer failed, give up on DMA and redo the batch
+    // by PIO.
+    st = inb(bmide+BM_STATUS);
+    outb(bmide+BM_CMD, 0);
+    outb(bmide+BM_STATUS, st | BM_ERR|BM_INTR);
+    if(idewait(1) < 0 || (st & BM_ERR)){
+      cprintf("ide: DMA failed, using PIO\n");
+      bmide = 0;
+      stats.dma = 0;
+      for(; b; b = next){
+        next = b->qnext;
+        idequeueadd(b);
+      }
+      idestart();
+      stats.cycles += rdtsc() - t0;
+      release(&idelock);
+      return;
+    }
+  } else if(!(b->flags & B_DIRTY) && idewait(1) >= 0){
+    // Read data if needed.
+    for(next = b; next; next = next->qnext)
+      insl(0x1f0, next->data, BSIZE/4);
+  }
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // Wake processes waiting for the batch's bufs.
+  done = 0;
+  for(; b; b = next){
+    next = b->qnext;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    if(b->flags & B_ASYNC){
+      b->qnext = done;
+      done = b;
+    } else
+      wakeup(b);
+  }
 
-  // Start disk on next buf in queue.
+  // Start disk on next batch in queue.
   if(idequeue != 0)
-    idestart(idequeue);
+    idestart();
 
+  stats.cycles += rdtsc() - t0;
+  release(&idelock);
+
+  // No process waits for these; hand them back to the cache.
+  for(; done; done = next){
+    next = done->qnext;
+    bdone(done);
+  }
+}
+
+// Copy the driver's statistics to st.
+void
+idestat(struct dstat *st)
+{
+  acquire(&idelock);
+  *st = stats;
   release(&idelock);
 }
 
@@ -134,12 +388,13 @@ ideintr(void)
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// If B_ASYNC is set, return once the request is queued; the
+// buf's lock is then held for no process, and ideintr calls
+// bdone when the request finishes.
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
-
-  if(!holdingsleep(&b->lock))
+  if((b->flags & B_ASYNC) ? !lockedsleep(&b->lock) : !holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
     panic("iderw: nothing to do");
@@ -148,17 +403,18 @@ iderw(struct buf *b)
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  idequeueadd(b);
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  if(ideactive == 0)
+    idestart();
 
-  // Wait for request to finish.
+  // Wait for request to finish, unless it is asynchronous:
+  // then b may be done and reused as soon as we let go.
+  if(b->flags & B_ASYNC){
+    release(&idelock);
+    return;
+  }
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
@@ -0,0 +1,467 @@
+// Kernel microbenchmarks, in the style of lmbench.
+//
+//   kbench [-p maxproc] [-n iters] [test ...]
+//
+// Tests (default all):
+//   null    getpid(), a system call that does no work
+//   sbrk    grow and shrink by a page: kalloc+kfree, both
+//           under the shared kmem lock
+//   pipe    one-byte round trip between two processes
+//   ctxsw   pipe round trip, one pair, with 0-48 idle processes
+//   fork    fork+exit+wait
+//   exec    fork+exec+exit+wait of a trivial program
+//   open    open+close of an existing file
+//   read    small read from a cached file
+//   write   small write to a file
+//   mutex   mutex_lock+mutex_unlock, uncontended
+//   futex   round trip between two threads handing a word
+//           back and forth with futex_wait and futex_wake
+//
+// Each test runs with 1, 2, 4, ... maxproc (default 8)
+// concurrent processes doing iters (default 200) operations
+// each, and prints one line per configuration (see bench.h).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mmu.h"
+#include "x86.h"
+#include "bench.h"
+
+#define IOSIZE   64     // bytes per read or write
+#define FILESIZE 4096   // size of the read and write test files
+
+int iters = 200;
+char buf[FILESIZE];
+
+char*
+filename(char *name, int id)
+{
+  strcpy(name, "kbf0");
+  name[3] = '0' + id;
+  return name;
+}
+
+void
+null(int id, uint *s, int n, void *arg)
+{
+  uint64 t0;
+  int i;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    getpid();
+    s[i] = rdtsc() - t0;
+  }
+}
+
+void
+sbrkone(int id, uint *s, int n, void *arg)
+{
+  uint64 t0;
+  int i;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if(sbrk(PGSIZE) == (char*)-1 || sbrk(-PGSIZE) == (char*)-1)
+      benchfail("sbrk");
+    s[i] = rdtsc() - t0;
+  }
+}
+
+void
+pingpong(int id, uint *s, int n, void *arg)
+{
+  int ping[2], pong[2], i, pid;
+  uint64 t0;
+  char c;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0)
+    benchfail("pipe");
+  if((pid = fork()) < 0)
+    benchfail("fork");
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit();
+  }
+  close(ping[0]);
+  close(pong[1]);
+  c = 'x';
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+      benchfail("pipe");
+    s[i] = rdtsc() - t0;
+  }
+  close(ping[1]);
+  close(pong[0]);
+  wait();
+}
+
+void
+forkone(int id, uint *s, int n, void *arg)
+{
+  uint64 t0;
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = fork()) < 0)
+      benchfail("fork");
+    if(pid == 0)
+      exit();
+    wait();
+    s[i] = rdtsc() - t0;
+  }
+}
+
+// The child runs "kbench -x", which exits at once.
+void
+execone(int id, uint *s, int n, void *arg)
+{
+  char *argv[] = { "kbench", "-x", 0 };
+  uint64 t0;
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = fork()) < 0)
+      benchfail("fork");
+    if(pid == 0){
+      exec(argv[0], argv);
+      benchfail("exec");
+    }
+    wait();
+    s[i] = rdtsc() - t0;
+  }
+}
+
+void
+openclose(int id, uint *s, int n, void *arg)
+{
+  char name[8];
+  uint64 t0;
+  int i, fd;
+
+  filename(name, id);
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((fd = open(name, O_RDONLY)) < 0)
+      benchfail("open");
+    close(fd);
+    s[i] = rdtsc() - t0;
+  }
+}
+
+// Read the file IOSIZE bytes at a time, reopening it
+// (untimed) at end of file.
+void
+readsmall(int id, uint *s, int n, void *arg)
+{
+  char name[8];
+  uint64 t0;
+  int i, fd, off;
+
+  filename(name, id);
+  fd = -1;
+  off = FILESIZE;
+  for(i = 0; i < n; i++){
+    if(off == FILESIZE){
+      close(fd);
+      if((fd = open(name, O_RDONLY)) < 0)
+        benchfail("open");
+      off = 0;
+    }
+    t0 = rdtsc();
+    if(read(fd, buf, IOSIZE) != IOSIZE)
+      benchfail("read");
+    s[i] = rdtsc() - t0;
+    off += IOSIZE;
+  }
+  close(fd);
+}
+
+// Append IOSIZE bytes at a time, starting a new file
+// (untimed) when it reaches FILESIZE.
+void
+writesmall(int id, uint *s, int n, void *arg)
+{
+  char name[8];
+  uint64 t0;
+  int i, fd, off;
+
+  filename(name, id);
+  fd = -1;
+  off = FILESIZE;
+  for(i = 0; i < n; i++){
+    if(off == FILESIZE){
+      close(fd);
+      unlink(name);
+      if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+        benchfail("create");
+      off = 0;
+    }
+    t0 = rdtsc();
+    if(write(fd, buf, IOSIZE) != IOSIZE)
+      benchfail("write");
+    s[i] = rdtsc() - t0;
+    off += IOSIZE;
+  }
+  close(fd);
+}
+
+void
+mutexone(int id, uint *s, int n, void *arg)
+{
+  mutex_t m;
+  uint64 t0;
+  int i;
+
+  mutex_init(&m);
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    mutex_lock(&m);
+    mutex_unlock(&m);
+    s[i] = rdtsc() - t0;
+  }
+}
+
+struct handoff {
+  volatile int turn;  // 1 when the partner thread is to run
+  int n;
+};
+
+void
+partner(void *arg)
+{
+  struct handoff *h = arg;
+  int i;
+
+  for(i = 0; i < h->n; i++){
+    while(h->turn == 0)
+      futex_wait(&h->turn, 0);
+    h->turn = 0;
+    futex_wake(&h->turn, 1);
+  }
+}
+
+// One sample is two handoffs: wake the partner thread and
+// sleep until it wakes us back.
+void
+handoff(int id, uint *s, int n, void *arg)
+{
+  struct handoff h;
+  uint64 t0;
+  int i;
+
+  h.turn = 0;
+  h.n = n;
+  if(thread_create(partner, &h) < 0)
+    benchfail("thread_create");
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    h.turn = 1;
+    futex_wake(&h.turn, 1);
+    while(h.turn == 1)
+      futex_wait(&h.turn, 1);
+    s[i] = rdtsc() - t0;
+  }
+  thread_join();
+}
+
+// Give every process a FILESIZE file to open and read.
+void
+makefiles(void)
+{
+  char name[8];
+  int i, fd;
+
+  for(i = 0; i < benchmaxproc; i++){
+    unlink(filename(name, i));
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0 ||
+       write(fd, buf, FILESIZE) != FILESIZE)
+      benchfail("create");
+    close(fd);
+  }
+}
+
+void
+removefiles(void)
+{
+  char name[8];
+  int i;
+
+  for(i = 0; i < benchmaxproc; i++)
+    unlink(filename(name, i));
+}
+
+void
+runnull(void)
+{
+  benchsweep("null", "", null, 0, iters);
+}
+
+void
+runsbrk(void)
+{
+  benchsweep("sbrk", "", sbrkone, 0, iters);
+}
+
+void
+runpipe(void)
+{
+  benchsweep("pipe", "", pingpong, 0, iters);
+}
+
+// Context switch cost should not depend on how many other
+// processes exist, so repeat the round trip with idle
+// processes sleeping in the background.
+void
+runctxsw(void)
+{
+  static int nidle[] = { 0, 16, 32, 48 };
+  char params[24];
+  int i, j, fd[2];
+  uint64 wall;
+  char c;
+  uint *s;
+
+  if((s = malloc(iters * sizeof(uint))) == 0)
+    benchfail("malloc");
+  for(i = 0; i < sizeof(nidle)/sizeof(nidle[0]); i++){
+    if(pipe(fd) < 0)
+      benchfail("pipe");
+    for(j = 0; j < nidle[i]; j++){
+      if(fork() == 0){
+        close(fd[1]);
+        read(fd[0], &c, 1);
+        exit();
+      }
+    }
+    close(fd[0]);
+    if(benchrun(1, pingpong, 0, s, iters, &wall) < 0)
+      benchfail("ctxsw");
+    benchreport("ctxsw", benchparam(params, "idle", nidle[i]), 1, s, iters, wall);
+    close(fd[1]);
+    for(j = 0; j < nidle[i]; j++)
+      wait();
+  }
+  free(s);
+}
+
+void
+runfork(void)
+{
+  benchsweep("fork", "", forkone, 0, iters/4 > 0 ? iters/4 : 1);
+}
+
+void
+runexec(void)
+{
+  benchsweep("exec", "", execone, 0, iters/4 > 0 ? iters/4 : 1);
+}
+
+void
+runopen(void)
+{
+  makefiles();
+  benchsweep("open", "", openclose, 0, iters);
+  removefiles();
+}
+
+void
+runread(void)
+{
+  char params[24];
+
+  makefiles();
+  benchsweep("read", benchparam(params, "size", IOSIZE), readsmall, 0, iters);
+  removefiles();
+}
+
+void
+runwrite(void)
+{
+  char params[24];
+
+  benchsweep("write", benchparam(params, "size", IOSIZE), writesmall, 0, iters);
+  removefiles();
+}
+
+void
+runmutex(void)
+{
+  benchsweep("mutex", "", mutexone, 0, iters);
+}
+
+void
+runfutex(void)
+{
+  benchsweep("futex", "", handoff, 0, iters);
+}
+
+struct {
+  char *name;
+  void (*run)(void);
+} tests[] = {
+  { "null",  runnull },
+  { "sbrk",  runsbrk },
+  { "pipe",  runpipe },
+  { "ctxsw", runctxsw },
+  { "fork",  runfork },
+  { "exec",  runexec },
+  { "open",  runopen },
+  { "read",  runread },
+  { "write", runwrite },
+  { "mutex", runmutex },
+  { "futex", runfutex },
+};
+
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+void
+usage(void)
+{
+  printf(2, "usage: kbench [-p maxproc] [-n iters] [test ...]\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n;
+
+  // Target of the exec test.
+  if(argc == 2 && strcmp(argv[1], "-x") == 0)
+    exit();
+
+  for(i = 1; i+1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-p") == 0)
+      benchmaxproc = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      iters = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(benchmaxproc < 1 || benchmaxproc > BENCHMAXPROC || iters < 1)
+    usage();
+  argv += i;
+  argc -= i;
+  for(i = 0; i < argc; i++){
+    n = 0;
+    for(j = 0; j < NTEST; j++)
+      n += benchselected(tests[j].name, &argv[i], 1);
+    if(n == 0)
+      usage();
+  }
+
+  benchinit("kbench");
+  for(j = 0; j < NTEST; j++)
+    if(benchselected(tests[j].name, argv, argc))
+      tests[j].run();
+  exit();
+}
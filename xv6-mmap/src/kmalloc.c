@@ -2,6 +2,8 @@
 #include "stat.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
 
 // Memory Allocator for the xv6 kernel.
 // Code based off of umalloc.c:
@@ -22,9 +24,17 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static struct spinlock lock;  // protects base and the free list
 
 void
-kmfree(void *ap)
+kmallocinit(void)
+{
+  initlock(&lock, "kmalloc");
+}
+
+// Return block ap to the free list.  Caller holds lock.
+static void
+freeblock(void *ap)
 {
   Header *bp, *p;
 
@@ -61,23 +71,32 @@ morecore(uint nu)
   if(p == 0)
     return 0;
   hp = (Header*)p;
-  hp->s.size = 4096; //kalloc always allocates 4096 bytes
-  kmfree((void*)(hp + 1));
+  hp->s.size = PGSIZE / sizeof(Header); //kalloc always allocates one page
+  freeblock((void*)(hp + 1));
   return freep;
 }
 
+void
+kmfree(void *ap)
+{
+  acquire(&lock);
+  freeblock(ap);
+  release(&lock);
+}
+
 void*
 kmalloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
 
-  if(nbytes > 4096)
+  if(nbytes > PGSIZE - sizeof(Header))
   {
     panic("kmalloc: requested more than allowed in a single allocation");
   }
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  acquire(&lock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -95,10 +114,13 @@ kmalloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      release(&lock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        release(&lock);
         return 0;
+      }
   }
 }
@@ -0,0 +1,458 @@
+// Sampling profiler front end.
+//
+//   kprof [-o file] command [args...]
+//       turn profiling on, run command, and save the
+//       samples to file (default prof.out).
+//   kprof -r [-f] [file]
+//       symbolize the samples in file against kernel.sym and
+//       the programs' .sym files and print a flat profile, or
+//       with -f, one folded stack per line ("a;b;c count"),
+//       ready for flame graph tools.
+//
+// Like ktrace, a child drains the per-CPU sample queues while
+// the command runs.  It merges identical samples in memory and
+// writes each distinct one with its count when profiling stops,
+// so the file grows with the number of distinct stacks, not with
+// the run time.  A file holds at most MAXFILE blocks, so at most
+// MAXREC (about 1200) distinct samples; samples beyond that are
+// counted as dropped, and kprof says so.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "memlayout.h"
+#include "prof.h"
+
+#define NREC     64    // samples per profread/read call
+#define NSYMTAB  16    // symbol tables kept loaded
+#define NENTRY   512   // distinct functions or stacks reported
+#define STACKLEN 256   // longest folded stack string
+#define NSLOT    2048  // hash slots for merging samples; > MAXREC
+
+// A distinct sample and the number of times it was taken.
+struct profrec {
+  struct profsample s;
+  uint count;
+};
+
+#define MAXREC ((int)(MAXFILE*BSIZE / sizeof(struct profrec)))
+
+struct profsample rec[NREC];
+struct profrec prec[MAXREC];
+
+//
+// Recording.
+//
+
+struct profrec *slot[NSLOT];
+int nprec;
+uint lost;        // samples the kernel dropped
+uint unrecorded;  // samples that found prec full
+
+// Two samples merge if they would be reported the same way:
+// same program, both idle or neither, same stack.
+int
+samesample(struct profsample *a, struct profsample *b)
+{
+  int i;
+
+  if(strcmp(a->name, b->name) != 0 || (a->pid == 0) != (b->pid == 0) ||
+     a->user != b->user)
+    return 0;
+  for(i = 0; i < PROFDEPTH; i++)
+    if(a->pc[i] != b->pc[i])
+      return 0;
+  return 1;
+}
+
+// Count sample s, adding it to prec if it is new.
+void
+merge(struct profsample *s)
+{
+  struct profrec **sp;
+  uint h;
+  int i;
+
+  if(s->pid == -1){
+    lost += s->pc[0];
+    return;
+  }
+  h = s->pid == 0;
+  for(i = 0; i < PROFDEPTH; i++)
+    h = h*31 + s->pc[i];
+  for(sp = &slot[h % NSLOT]; *sp; ){
+    if(samesample(&(*sp)->s, s)){
+      (*sp)->count++;
+      return;
+    }
+    if(++sp == &slot[NSLOT])
+      sp = slot;
+  }
+  // Keep the last record for drain's drop record.
+  if(nprec == MAXREC-1){
+    unrecorded++;
+    return;
+  }
+  *sp = &prec[nprec++];
+  (*sp)->s = *s;
+  (*sp)->count = 1;
+}
+
+// Merge samples from the kernel until profiling is off and
+// the queues are empty, then write the distinct samples to fd,
+// followed by one drop record if any samples were lost.
+void
+drain(int fd)
+{
+  struct profrec *r;
+  int i, n, on;
+
+  for(;;){
+    on = profctl(-1);
+    while((n = profread(rec, NREC)) > 0)
+      for(i = 0; i < n; i++)
+        merge(&rec[i]);
+    if(!on)
+      break;
+    sleep(1);
+  }
+
+  if(unrecorded){
+    printf(2, "kprof: more than %d distinct samples (MAXFILE is %d blocks); "
+           "%d samples counted as dropped\n", MAXREC-1, MAXFILE, unrecorded);
+    lost += unrecorded;
+  }
+  if(lost){
+    r = &prec[nprec++];
+    memset(r, 0, sizeof(*r));
+    strcpy(r->s.name, "dropped");
+    r->s.pid = -1;
+    r->s.pc[0] = lost;
+    r->count = 1;
+  }
+  if(write(fd, prec, nprec*sizeof(prec[0])) != nprec*sizeof(prec[0])){
+    printf(2, "kprof: write error\n");
+    exit();
+  }
+}
+
+void
+record(char *file, char **argv)
+{
+  int fd, pid, cmd, drainer;
+
+  unlink(file);
+  if((fd = open(file, O_CREATE|O_WRONLY)) < 0){
+    printf(2, "kprof: cannot open %s\n", file);
+    exit();
+  }
+
+  profctl(1);
+  if((drainer = fork()) == 0){
+    drain(fd);
+    exit();
+  }
+  if((cmd = fork()) == 0){
+    close(fd);
+    exec(argv[0], argv);
+    printf(2, "kprof: exec %s failed\n", argv[0]);
+    exit();
+  }
+  while((pid = wait()) >= 0 && pid != cmd)
+    ;
+  profctl(0);
+  if(drainer > 0)
+    wait();
+  close(fd);
+}
+
+//
+// Symbol tables, read from the "address name" lines that the
+// Makefile extracts with objdump -t.
+//
+
+struct symtab {
+  char prog[16];   // program name, or "kernel"
+  int n;           // number of symbols, sorted by address
+  uint *addr;
+  char **name;
+};
+
+struct symtab symtab[NSYMTAB];
+int nsymtab;
+
+uint
+hex(char *s)
+{
+  uint x;
+
+  x = 0;
+  for(;;){
+    if(*s >= '0' && *s <= '9')
+      x = x*16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      x = x*16 + *s - 'a' + 10;
+    else
+      return x;
+    s++;
+  }
+}
+
+void
+sortsyms(struct symtab *t)
+{
+  int gap, i, j;
+  uint a;
+  char *s;
+
+  for(gap = t->n/2; gap > 0; gap /= 2)
+    for(i = gap; i < t->n; i++)
+      for(j = i-gap; j >= 0 && t->addr[j] > t->addr[j+gap]; j -= gap){
+        a = t->addr[j]; t->addr[j] = t->addr[j+gap]; t->addr[j+gap] = a;
+        s = t->name[j]; t->name[j] = t->name[j+gap]; t->name[j+gap] = s;
+      }
+}
+
+// Return the symbol table for prog, loading prog.sym if needed.
+// Returns 0 if there is no usable table.
+struct symtab*
+loadsyms(char *prog)
+{
+  struct symtab *t;
+  struct stat st;
+  char path[32], *buf, *p, *line;
+  int fd, i, n;
+
+  for(t = symtab; t < &symtab[nsymtab]; t++)
+    if(strcmp(t->prog, prog) == 0)
+      return t->n > 0 ? t : 0;
+  if(nsymtab == NSYMTAB)
+    return 0;
+  t = &symtab[nsymtab++];
+  strcpy(t->prog, prog);
+  t->n = 0;
+
+  if(strlen(prog) + 5 > sizeof(path))
+    return 0;
+  strcpy(path, prog);
+  strcpy(path + strlen(path), ".sym");
+  if((fd = open(path, O_RDONLY)) < 0)
+    return 0;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size+1)) == 0){
+    close(fd);
+    return 0;
+  }
+  n = read(fd, buf, st.size);
+  close(fd);
+  if(n < 0)
+    n = 0;
+  buf[n] = 0;
+
+  n = 0;
+  for(p = buf; *p; p++)
+    if(*p == '\n')
+      n++;
+  t->addr = malloc(n * sizeof(uint));
+  t->name = malloc(n * sizeof(char*));
+  if(t->addr == 0 || t->name == 0)
+    return 0;
+
+  i = 0;
+  for(line = buf; *line && i < n; line = p+1){
+    p = strchr(line, '\n');
+    if(p == 0)
+      break;
+    *p = 0;
+    if(strlen(line) < 10 || line[8] != ' ')
+      continue;
+    t->addr[i] = hex(line);
+    t->name[i] = line + 9;
+    // Skip file names and other zero-address entries.
+    if(t->addr[i] != 0)
+      i++;
+  }
+  t->n = i;
+  sortsyms(t);
+  return t->n > 0 ? t : 0;
+}
+
+// Return the name of the symbol containing pc, or 0.
+char*
+lookup(struct symtab *t, uint pc)
+{
+  int lo, hi, mid;
+
+  if(t == 0 || t->n == 0 || pc < t->addr[0])
+    return 0;
+  lo = 0;
+  hi = t->n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(t->addr[mid] <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return t->name[lo];
+}
+
+// Append the name of pc, as seen by sample s, to buf.
+void
+symbolize(char *buf, int len, struct profsample *s, uint pc)
+{
+  static char digits[] = "0123456789abcdef";
+  char *name, tmp[12];
+  int i, kernel;
+
+  kernel = pc >= KERNBASE;
+  name = lookup(loadsyms(kernel ? "kernel" : s->name), pc);
+  if(name == 0){
+    tmp[0] = '0';
+    tmp[1] = 'x';
+    for(i = 0; i < 8; i++)
+      tmp[2+i] = digits[(pc >> (28 - 4*i)) & 0xf];
+    tmp[10] = 0;
+    name = tmp;
+  }
+  i = strlen(buf);
+  if(!kernel && i + strlen(s->name) + 2 < len){
+    strcpy(buf+i, s->name);
+    i += strlen(s->name);
+    buf[i++] = ':';
+    buf[i] = 0;
+  }
+  if(i + strlen(name) + 1 < len)
+    strcpy(buf+i, name);
+}
+
+//
+// Reporting.
+//
+
+struct entry {
+  char *key;
+  int count;
+};
+
+struct entry entry[NENTRY];
+int nentry;
+
+void
+count(char *key, int n)
+{
+  struct entry *e;
+
+  for(e = entry; e < &entry[nentry]; e++)
+    if(strcmp(e->key, key) == 0){
+      e->count += n;
+      return;
+    }
+  if(nentry == NENTRY)
+    return;
+  e = &entry[nentry++];
+  if((e->key = malloc(strlen(key)+1)) == 0){
+    nentry--;
+    return;
+  }
+  strcpy(e->key, key);
+  e->count = n;
+}
+
+void
+report(char *file, int folded)
+{
+  char key[STACKLEN];
+  struct profsample *s;
+  int fd, i, j, n, depth, total, dropped;
+  struct entry tmp;
+
+  if((fd = open(file, O_RDONLY)) < 0){
+    printf(2, "kprof: cannot open %s\n", file);
+    exit();
+  }
+  total = 0;
+  dropped = 0;
+  while((n = read(fd, prec, NREC*sizeof(prec[0]))) > 0){
+    n /= sizeof(prec[0]);
+    for(i = 0; i < n; i++){
+      s = &prec[i].s;
+      if(s->pid == -1){
+        dropped += s->pc[0];
+        continue;
+      }
+      total += prec[i].count;
+      key[0] = 0;
+      if(!folded){
+        symbolize(key, sizeof(key), s, s->pc[0]);
+      } else {
+        strcpy(key, s->pid ? s->name : "idle");
+        for(depth = 0; depth < PROFDEPTH && s->pc[depth]; depth++)
+          ;
+        for(j = depth-1; j >= 0; j--){
+          if(strlen(key) + 2 >= sizeof(key))
+            break;
+          strcpy(key + strlen(key), ";");
+          symbolize(key, sizeof(key), s, s->pc[j]);
+          if(s->pc[j] >= KERNBASE && strlen(key) + 5 < sizeof(key))
+            strcpy(key + strlen(key), "_[k]");
+        }
+      }
+      count(key, prec[i].count);
+    }
+  }
+  close(fd);
+
+  // Sort by count, highest first.
+  for(i = 0; i < nentry; i++)
+    for(j = i+1; j < nentry; j++)
+      if(entry[j].count > entry[i].count){
+        tmp = entry[i];
+        entry[i] = entry[j];
+        entry[j] = tmp;
+      }
+
+  if(folded){
+    for(i = 0; i < nentry; i++)
+      printf(1, "%s %d\n", entry[i].key, entry[i].count);
+  } else {
+    printf(1, "samples %d dropped %d\n", total, dropped);
+    for(i = 0; i < nentry; i++)
+      printf(1, "%d %d%% %s\n", entry[i].count,
+             entry[i].count*100/total, entry[i].key);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *file;
+  int folded;
+
+  file = "prof.out";
+  if(argc >= 2 && strcmp(argv[1], "-r") == 0){
+    folded = 0;
+    argv += 2;
+    argc -= 2;
+    if(argc > 0 && strcmp(argv[0], "-f") == 0){
+      folded = 1;
+      argv++;
+      argc--;
+    }
+    report(argc > 0 ? argv[0] : file, folded);
+    exit();
+  }
+  if(argc >= 3 && strcmp(argv[1], "-o") == 0){
+    file = argv[2];
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 2){
+    printf(2, "usage: kprof [-o file] command [args...]\n");
+    printf(2, "       kprof -r [-f] [file]\n");
+    exit();
+  }
+  record(file, argv+1);
+  exit();
+}
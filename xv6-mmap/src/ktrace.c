@@ -0,0 +1,163 @@
+// Record kernel trace events while a command runs.
+//
+//   ktrace [-o file] command [args...]
+//       turn tracing on, run command, and save the binary
+//       trace records to file (default trace.out).
+//   ktrace -p [file]
+//       print the records saved in file as text.
+//
+// A child process drains the per-CPU rings into the file
+// while the command runs, so the rings do not overflow.  The
+// drainer's own system calls are not traced.  A file holds at
+// most MAXFILE blocks, about 3000 records; once it is full,
+// ktrace says so and turns tracing off.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "trace.h"
+
+#define NREC 128  // records per traceread call
+#define MAXREC ((int)(MAXFILE*BSIZE / sizeof(struct traceent)))
+
+char *evnames[] = {
+[TR_SYSENTER] "sysenter",
+[TR_SYSEXIT]  "sysexit",
+[TR_FAULT]    "fault",
+[TR_SWITCH]   "switch",
+[TR_BMISS]    "bmiss",
+[TR_LOST]     "lost",
+[TR_STEAL]    "steal",
+};
+
+struct traceent rec[NREC];
+
+// Print a 64-bit value as 16 hex digits.
+void
+printhex64(int fd, uint64 x)
+{
+  static char digits[] = "0123456789abcdef";
+  char buf[17];
+  int i;
+
+  for(i = 15; i >= 0; i--){
+    buf[i] = digits[x & 0xf];
+    x >>= 4;
+  }
+  buf[16] = 0;
+  printf(fd, "%s", buf);
+}
+
+// Copy records from the kernel rings to fd until tracing is
+// off and the rings are empty, or fd holds MAXREC records.
+void
+drain(int fd)
+{
+  int n, on, nrec;
+
+  // Otherwise each traceread and write would add records
+  // of its own, and the rings would never empty.
+  tracectl(TC_NOSELF);
+  nrec = 0;
+  for(;;){
+    on = tracectl(-1);
+    while((n = traceread(rec, NREC)) > 0){
+      if(n > MAXREC - nrec)
+        n = MAXREC - nrec;
+      if(write(fd, rec, n*sizeof(rec[0])) != n*sizeof(rec[0])){
+        printf(2, "ktrace: write error\n");
+        exit();
+      }
+      nrec += n;
+      if(nrec == MAXREC){
+        printf(2, "ktrace: trace file full at %d records "
+               "(MAXFILE is %d blocks); tracing stopped\n", nrec, MAXFILE);
+        tracectl(0);
+        return;
+      }
+    }
+    if(!on)
+      break;
+    sleep(1);
+  }
+}
+
+void
+record(char *file, char **argv)
+{
+  int fd, pid, cmd, drainer;
+
+  unlink(file);
+  if((fd = open(file, O_CREATE|O_WRONLY)) < 0){
+    printf(2, "ktrace: cannot open %s\n", file);
+    exit();
+  }
+
+  tracectl(1);
+  if((drainer = fork()) == 0){
+    drain(fd);
+    exit();
+  }
+  if((cmd = fork()) == 0){
+    close(fd);
+    exec(argv[0], argv);
+    printf(2, "ktrace: exec %s failed\n", argv[0]);
+    exit();
+  }
+  while((pid = wait()) >= 0 && pid != cmd)
+    ;
+  tracectl(0);
+  if(drainer > 0)
+    wait();
+  close(fd);
+}
+
+void
+print(char *file)
+{
+  int fd, i, n;
+  struct traceent *e;
+
+  if((fd = open(file, O_RDONLY)) < 0){
+    printf(2, "ktrace: cannot open %s\n", file);
+    exit();
+  }
+  while((n = read(fd, rec, sizeof(rec))) > 0){
+    n /= sizeof(rec[0]);
+    for(i = 0; i < n; i++){
+      e = &rec[i];
+      printhex64(1, e->tsc);
+      if(e->event < sizeof(evnames)/sizeof(evnames[0]) && evnames[e->event])
+        printf(1, " %d %d %s %d\n", e->cpu, e->pid, evnames[e->event], e->arg);
+      else
+        printf(1, " %d %d ? %d\n", e->cpu, e->pid, e->arg);
+    }
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *file;
+
+  file = "trace.out";
+  if(argc >= 2 && strcmp(argv[1], "-p") == 0){
+    print(argc >= 3 ? argv[2] : file);
+    exit();
+  }
+  if(argc >= 3 && strcmp(argv[1], "-o") == 0){
+    file = argv[2];
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 2){
+    printf(2, "usage: ktrace [-o file] command [args...]\n");
+    printf(2, "       ktrace -p [file]\n");
+    exit();
+  }
+  record(file, argv+1);
+  exit();
+}
@@ -0,0 +1,63 @@
+// Print spin and sleep lock statistics (kernel built with
+// LOCKSTAT=1).  For sleep locks, sleep counts the contended
+// acquisitions that slept rather than spinning until the holder
+// released, and waitcycles the total wait: the handoff latency.
+//
+//   lockstat              print the counters
+//   lockstat -r           print the counters, then zero them
+//   lockstat command ...  zero the counters, run command, print
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NSTAT 64
+
+struct lockstat st[NSTAT];
+
+void
+dump(int reset)
+{
+  int i, n;
+
+  if((n = lockstat(st, NSTAT, reset)) < 0){
+    printf(2, "lockstat: kernel built without LOCKSTAT=1\n");
+    exit();
+  }
+  if(n > NSTAT)
+    n = NSTAT;
+  printf(1, "name acquire contend sleep waitcycles maxhold\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%s %l %l %l %l %l\n", st[i].name, st[i].nacquire,
+           st[i].ncontend, st[i].nsleep, st[i].spincycles, st[i].maxhold);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc < 2){
+    dump(0);
+    exit();
+  }
+  if(strcmp(argv[1], "-r") == 0){
+    dump(1);
+    exit();
+  }
+
+  if(lockstat(st, 0, 1) < 0){
+    printf(2, "lockstat: kernel built without LOCKSTAT=1\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    exec(argv[1], argv+1);
+    printf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  if(pid > 0)
+    wait();
+  dump(0);
+  exit();
+}
@@ -0,0 +1,14 @@
+// Per-lock statistics, kept by spinlock.c and sleeplock.c when
+// the kernel is built with LOCKSTAT=1 and returned by the
+// lockstat system call.  Locks initialized with the same name
+// share one entry.
+
+struct lockstat {
+  char name[16];        // name given to initlock()
+  uint64 nacquire;      // number of acquisitions
+  uint64 ncontend;      // acquisitions that found the lock held
+  uint64 nsleep;        // of those, ones that slept (sleep locks)
+  uint64 spincycles;    // cycles spent waiting in acquire(), or
+                        // spinning and sleeping in acquiresleep()
+  uint64 maxhold;       // longest hold time, in cycles
+};
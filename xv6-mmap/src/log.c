@@ -27,7 +27,10 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A commit writes all the log blocks at once and waits for
+// them, then writes the header and waits, then writes all the
+// home locations at once and waits, then erases the header.
+// Only those waits order the disk writes.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -69,15 +72,19 @@ initlog(int dev)
 static void
 install_trans(void)
 {
+  struct buf *dbuf[LOGSIZE];
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
+    dbuf[tail] = bread(log.dev, log.lh.block[tail]); // read dst
+    memmove(dbuf[tail]->data, lbuf->data, BSIZE);  // copy block to dst
     brelse(lbuf);
-    brelse(dbuf);
+    bawrite(dbuf[tail]);  // start writing dst to disk
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(dbuf[tail]);
+    brelse(dbuf[tail]);
   }
 }
 
@@ -128,12 +135,15 @@ begin_op(void)
   acquire(&log.lock);
   while(1){
     if(log.committing){
-      sleep(&log, &log.lock);
+      sleepexcl(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      sleepexcl(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      // waiters are woken one at a time; pass the wakeup
+      // on in case there is room for the next one too.
+      wakeup(&log);
       release(&log.lock);
       break;
     }
@@ -177,15 +187,19 @@ end_op(void)
 static void
 write_log(void)
 {
+  struct buf *to[LOGSIZE];
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    to[tail] = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    memmove(to[tail]->data, from->data, BSIZE);
     brelse(from);
-    brelse(to);
+    bawrite(to[tail]);  // start writing the log
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(to[tail]);
+    brelse(to[tail]);
   }
 }
 
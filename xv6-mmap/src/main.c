@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -19,6 +20,7 @@ main(void)
 {
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
   kvmalloc();      // kernel page table
+  kmallocinit();   // kernel heap for small objects
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
   seginit();       // segment descriptors
@@ -27,7 +29,10 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  futexinit();     // futex locks
   tvinit();        // trap vectors
+  traceinit();     // kernel event trace
+  profinit();      // sampling profiler
   binit();         // buffer cache
   fileinit();      // file table
   ideinit();       // disk 
@@ -5,22 +5,26 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "bstat.h"
 
 extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
 
 static int disksize;
 static uchar *memdisk;
+static struct spinlock statlock;
+static struct dstat stats;
 
 void
 ideinit(void)
 {
+  initlock(&statlock, "memide");
   memdisk = _binary_fs_img_start;
   disksize = (uint)_binary_fs_img_size/BSIZE;
 }
@@ -35,12 +39,15 @@ ideintr(void)
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// The copy is synchronous, so a B_ASYNC request is finished
+// with bdone at once.
 void
 iderw(struct buf *b)
 {
   uchar *p;
+  uint64 t0;
 
-  if(!holdingsleep(&b->lock))
+  if((b->flags & B_ASYNC) ? !lockedsleep(&b->lock) : !holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
     panic("iderw: nothing to do");
@@ -49,6 +56,7 @@ iderw(struct buf *b)
   if(b->blockno >= disksize)
     panic("iderw: block out of range");
 
+  t0 = rdtsc();
   p = memdisk + b->blockno*BSIZE;
 
   if(b->flags & B_DIRTY){
@@ -57,4 +65,20 @@ iderw(struct buf *b)
   } else
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
+  acquire(&statlock);
+  stats.cmds++;
+  stats.sectors += BSIZE/512;
+  stats.cycles += rdtsc() - t0;
+  release(&statlock);
+  if(b->flags & B_ASYNC)
+    bdone(b);
+}
+
+// Copy the driver's statistics to st.
+void
+idestat(struct dstat *st)
+{
+  acquire(&statlock);
+  *st = stats;
+  release(&statlock);
 }
@@ -0,0 +1,11 @@
+// An address space.  Threads created with clone() share
+// their creator's.
+struct mm {
+  struct sleeplock lock;       // serializes changes to the fields below
+  int ref;                     // threads using it; protected by ptable.lock
+  pde_t *pgdir;                // Page table
+  uint sz;                     // Size of process memory (bytes)
+  int nregions;                // number of allocated regions
+  mmapped_region *region_head; // head of mapped region list
+  char *sink;                  // page behind late kernel accesses (see sinkfault)
+};
@@ -0,0 +1,275 @@
+// Virtual memory benchmarks.
+//
+//   mmapbench [-p maxproc] [-n iters] [test ...]
+//
+// Tests (default all):
+//   mmap       mmap+munmap of an anonymous region, per call
+//   anonfault  first touch of each page of an anonymous region
+//   filefault  first touch of each page of a file mapping
+//   msync      write-back of a dirty shared file mapping
+//   fork       fork+exit+wait with a large populated mapping
+//
+// Each test runs with 1, 2, 4, ... maxproc (default 8)
+// concurrent processes doing iters (default 64) operations
+// each, and prints one line per configuration (see bench.h).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mmu.h"
+#include "x86.h"
+#include "mmap.h"
+#include "bench.h"
+
+#define FILEPAGES 8   // pages per process in filefault
+
+int iters = 64;
+char pagebuf[PGSIZE];
+volatile char sink;
+
+char*
+filename(char *buf, int id)
+{
+  strcpy(buf, "mmbf0");
+  buf[4] = '0' + id;
+  return buf;
+}
+
+// Create a file of npages pages; page i is filled with i+1.
+int
+makefile(char *name, int npages)
+{
+  int fd, i;
+
+  unlink(name);
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+    return -1;
+  for(i = 0; i < npages; i++){
+    memset(pagebuf, i+1, PGSIZE);
+    if(write(fd, pagebuf, PGSIZE) != PGSIZE){
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+void
+mmapone(int id, uint *s, int n, void *arg)
+{
+  uint size = (uint)arg;
+  uint64 t0;
+  char *a;
+  int i;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    a = mmap(0, size, PROT_WRITE, MAP_ANONYMOUS, -1, 0);
+    if(a == (char*)-1)
+      benchfail("mmap");
+    if(munmap(a, size) < 0)
+      benchfail("munmap");
+    s[i] = rdtsc() - t0;
+  }
+}
+
+// One sample per page.  mmap currently populates the region
+// when it is created, so this times the first touch of a
+// resident page; with demand paging it times the fault.
+void
+anonfault(int id, uint *s, int n, void *arg)
+{
+  uint64 t0;
+  char *a;
+  int i;
+
+  if((a = mmap(0, n*PGSIZE, PROT_WRITE, MAP_ANONYMOUS, -1, 0)) == (char*)-1)
+    benchfail("mmap");
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    a[i*PGSIZE] = 1;
+    s[i] = rdtsc() - t0;
+  }
+  munmap(a, n*PGSIZE);
+}
+
+void
+filefault(int id, uint *s, int n, void *arg)
+{
+  char name[8], *a;
+  uint64 t0;
+  int fd, i;
+
+  if((fd = open(filename(name, id), O_RDWR)) < 0)
+    benchfail("open");
+  a = mmap(0, n*PGSIZE, PROT_WRITE, MAP_FILE, fd, 0);
+  if(a == (char*)-1)
+    benchfail("mmap");
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    sink = a[i*PGSIZE];
+    s[i] = rdtsc() - t0;
+  }
+  munmap(a, n*PGSIZE);
+  close(fd);
+}
+
+// Does mmap(MAP_FILE) show the file's contents?
+int
+filemapped(void)
+{
+  char name[8], *a;
+  int fd, ok;
+
+  if(makefile(filename(name, 0), 1) < 0 || (fd = open(name, O_RDWR)) < 0)
+    benchfail("create");
+  ok = 0;
+  a = mmap(0, PGSIZE, PROT_WRITE, MAP_FILE, fd, 0);
+  if(a != (char*)-1){
+    ok = a[0] == 1 && a[PGSIZE-1] == 1;
+    munmap(a, PGSIZE);
+  }
+  close(fd);
+  unlink(name);
+  return ok;
+}
+
+void
+forkone(int id, uint *s, int n, void *arg)
+{
+  uint size = (uint)arg;
+  uint64 t0;
+  char *a;
+  int i, pid;
+
+  a = 0;
+  if(size > 0){
+    if((a = mmap(0, size, PROT_WRITE, MAP_ANONYMOUS, -1, 0)) == (char*)-1)
+      benchfail("mmap");
+    for(i = 0; i < size; i += PGSIZE)
+      a[i] = 1;
+  }
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = fork()) < 0)
+      benchfail("fork");
+    if(pid == 0)
+      exit();
+    wait();
+    s[i] = rdtsc() - t0;
+  }
+  if(size > 0)
+    munmap(a, size);
+}
+
+void
+runmmap(void)
+{
+  static uint sizes[] = { PGSIZE, 16*PGSIZE, 256*PGSIZE };
+  char params[24];
+  int i;
+
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    benchsweep("mmap", benchparam(params, "size", sizes[i]),
+          mmapone, (void*)sizes[i], iters);
+}
+
+void
+runanonfault(void)
+{
+  benchsweep("anonfault", "", anonfault, 0, iters);
+}
+
+void
+runfilefault(void)
+{
+  char name[8];
+  int i, n;
+
+  if(!filemapped()){
+    printf(1, "%s test=filefault unsupported=1\n", benchname);
+    return;
+  }
+  n = iters < FILEPAGES ? iters : FILEPAGES;
+  for(i = 0; i < benchmaxproc; i++)
+    if(makefile(filename(name, i), n) < 0)
+      benchfail("create");
+  benchsweep("filefault", "", filefault, 0, n);
+  for(i = 0; i < benchmaxproc; i++)
+    unlink(filename(name, i));
+}
+
+// There is no msync (or MAP_SHARED) yet; say so, so that
+// result files always list every test.
+void
+runmsync(void)
+{
+  printf(1, "%s test=msync unsupported=1\n", benchname);
+}
+
+void
+runfork(void)
+{
+  static uint sizes[] = { 0, 64*PGSIZE, 256*PGSIZE, 1024*PGSIZE };
+  char params[24];
+  int i, n;
+
+  n = iters/4 > 0 ? iters/4 : 1;
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    benchsweep("fork", benchparam(params, "size", sizes[i]),
+          forkone, (void*)sizes[i], n);
+}
+
+struct {
+  char *name;
+  void (*run)(void);
+} tests[] = {
+  { "mmap",      runmmap },
+  { "anonfault", runanonfault },
+  { "filefault", runfilefault },
+  { "msync",     runmsync },
+  { "fork",      runfork },
+};
+
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+void
+usage(void)
+{
+  printf(2, "usage: mmapbench [-p maxproc] [-n iters] [test ...]\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n;
+
+  for(i = 1; i+1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-p") == 0)
+      benchmaxproc = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      iters = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(benchmaxproc < 1 || benchmaxproc > BENCHMAXPROC || iters < 1)
+    usage();
+  argv += i;
+  argc -= i;
+  for(i = 0; i < argc; i++){
+    n = 0;
+    for(j = 0; j < NTEST; j++)
+      n += benchselected(tests[j].name, &argv[i], 1);
+    if(n == 0)
+      usage();
+  }
+
+  benchinit("mmapbench");
+  for(j = 0; j < NTEST; j++)
+    if(benchselected(tests[j].name, argv, argc))
+      tests[j].run();
+  exit();
+}
@@ -0,0 +1,27 @@
+// Run a command with a nice level.
+//
+//   nice level command [args...]
+//
+// The command never runs above priority level, 0 (the
+// default) to NPRIO-1, so a batch job started with a high
+// level stays out of the way of interactive programs.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    printf(2, "usage: nice level command [args...]\n");
+    exit();
+  }
+  if(nice(0, atoi(argv[1])) < 0){
+    printf(2, "nice: bad level %s\n", argv[1]);
+    exit();
+  }
+  exec(argv[2], argv+2);
+  printf(2, "nice: exec %s failed\n", argv[2]);
+  exit();
+}
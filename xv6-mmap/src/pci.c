@@ -0,0 +1,60 @@
+// PCI configuration space, by configuration mechanism #1.
+//
+// A function is named by a tag holding its bus, device and
+// function numbers, in the layout of the address register.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+
+#define PCI_ADDR  0xcf8
+#define PCI_DATA  0xcfc
+
+#define PCI_ID        0x00  // vendor and device IDs
+#define PCI_CLASS     0x08  // class, subclass, interface, revision
+#define PCI_HEADER    0x0c  // bit 23 of this: multi-function device
+
+#define PCITAG(bus, dev, func) (((bus)<<16) | ((dev)<<11) | ((func)<<8))
+
+uint
+pciread(uint tag, int reg)
+{
+  outl(PCI_ADDR, 0x80000000 | tag | (reg & 0xfc));
+  return inl(PCI_DATA);
+}
+
+void
+pciwrite(uint tag, int reg, uint v)
+{
+  outl(PCI_ADDR, 0x80000000 | tag | (reg & 0xfc));
+  outl(PCI_DATA, v);
+}
+
+// Find the first function on bus 0 whose class and subclass
+// are class>>8 and class&0xff, and set *tag to it.  Returns 0,
+// or -1 if there is none.  Only bus 0 is searched: that is
+// where PCs, and QEMU, put the chipset's own functions.
+int
+pcifind(uint class, uint *tag)
+{
+  int dev, func;
+  uint t;
+
+  for(dev = 0; dev < 32; dev++){
+    for(func = 0; func < 8; func++){
+      t = PCITAG(0, dev, func);
+      if((pciread(t, PCI_ID) & 0xffff) == 0xffff){
+        if(func == 0)
+          break;
+        continue;
+      }
+      if(pciread(t, PCI_CLASS) >> 16 == class){
+        *tag = t;
+        return 0;
+      }
+      if(func == 0 && (pciread(t, PCI_HEADER) & (1<<23)) == 0)
+        break;
+    }
+  }
+  return -1;
+}
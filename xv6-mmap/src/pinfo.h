@@ -0,0 +1,17 @@
+// Per-process information returned by the getpinfo system
+// call, for ps.  Latencies are in TSC cycles.
+
+struct pinfo {
+  int pid;
+  int state;            // enum procstate in proc.h
+  char name[16];
+  int prio;             // MLFQ level, 0 is highest
+  int nice;             // highest level the process may run at
+  int cpu;              // CPU it is queued on or last ran on
+  uint runticks;        // timer ticks charged to it
+  struct {
+    uint n;             // times dispatched at this level
+    uint64 sum;         // total wait from RUNNABLE to RUNNING
+    uint64 max;         // longest such wait
+  } lat[NPRIO];
+};
@@ -2,9 +2,9 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 
@@ -105,16 +105,21 @@ piperead(struct pipe *p, char *addr, int n)
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
     if(myproc()->killed){
+      wakeup(&p->nread);
       release(&p->lock);
       return -1;
     }
-    sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    sleepexcl(&p->nread, &p->lock); //DOC: piperead-sleep
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(p->nread == p->nwrite)
       break;
     addr[i] = p->data[p->nread++ % PIPESIZE];
   }
+  // Readers are woken one at a time; wake the next one
+  // if there is more to read or the pipe is closed.
+  if(p->nread != p->nwrite || !p->writeopen)
+    wakeup(&p->nread);
   wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
@@ -35,7 +35,38 @@ printint(int fd, int xx, int base, int sgn)
     putc(fd, buf[i]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
+// Print a 64-bit unsigned value in decimal.
+// Divides by shifting, since there is no libgcc for 64-bit division.
+static void
+printlong(int fd, uint64 x)
+{
+  char buf[24];
+  uint64 q;
+  uint r;
+  int i, b;
+
+  i = 0;
+  do{
+    q = 0;
+    r = 0;
+    for(b = 63; b >= 0; b--){
+      r = (r << 1) | ((x >> b) & 1);
+      q <<= 1;
+      if(r >= 10){
+        r -= 10;
+        q |= 1;
+      }
+    }
+    buf[i++] = '0' + r;
+    x = q;
+  }while(x != 0);
+
+  while(--i >= 0)
+    putc(fd, buf[i]);
+}
+
+// Print to the given fd. Only understands %d, %u, %l (64-bit
+// unsigned), %x, %p, %s.
 void
 printf(int fd, const char *fmt, ...)
 {
@@ -57,6 +88,12 @@ printf(int fd, const char *fmt, ...)
       if(c == 'd'){
         printint(fd, *ap, 10, 1);
         ap++;
+      } else if(c == 'u'){
+        printint(fd, *ap, 10, 0);
+        ap++;
+      } else if(c == 'l'){
+        printlong(fd, *(uint64*)ap);
+        ap += 2;
       } else if(c == 'x' || c == 'p'){
         printint(fd, *ap, 16, 0);
         ap++;
@@ -4,26 +4,119 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "slab.h"
+#include "trace.h"
+#include "pinfo.h"
+
+// Process structures come from a slab cache, so the number of
+// processes is limited only by memory.  Every process is on
+// ptable.list, for the few places that must visit them all,
+// and on a hash chain by pid.
+//
+// Locking.  ptable.lock covers the life cycle of processes:
+// allocating and freeing them, parent and child lists, and the
+// exit/wait handshake.  ptable.listlock covers the process
+// list and pid hash; they change only with both locks held,
+// so holding either one is enough to read them, and lookups
+// that need nothing else hold only listlock, for reading.
+// p->lock covers p->state and p->chan, and is held across the
+// context switch into and out of p (see sched and scheduler).
+// A run queue's lock covers the queue and the links of the
+// processes on it, and a wait queue's lock likewise.
+// Locks are acquired in the order ptable.lock, listlock, wait
+// queue lock, p->lock, run queue lock.
+#define NPIDHASH 1024
+#define PIDHASH(pid) (&ptable.pidhash[(uint)(pid) % NPIDHASH])
 
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct rwspinlock listlock;
+  struct slabcache cache;
+  struct proc *list;               // all processes, linked through allnext
+  struct proc *pidhash[NPIDHASH];  // linked through pidnext
 } ptable;
 
+// Address spaces and open file tables, which threads share.
+static struct slabcache mmcache;
+static struct slabcache fdtcache;
+
+// Per-CPU run queues.  A process is on exactly one run queue
+// while it is RUNNABLE and on none otherwise.  Each CPU's
+// scheduler takes processes from its own queue, so picking
+// the next process is O(1) and CPUs do not contend for a
+// global lock.  A CPU whose queue is empty steals from the
+// busiest other queue (see steal).
+//
+// Scheduling is a multi-level feedback queue: each run queue
+// holds one deque per priority level, and the scheduler runs
+// the head of the highest non-empty level (0 is highest).  A
+// process that uses up its level's quantum drops a level; one
+// that sleeps first keeps its level, so interactive processes
+// stay above CPU-bound ones.  Every BOOSTTICKS ticks all
+// processes go back to level 0 so none starves, except that
+// no process rises above its nice level.
+struct runq {
+  struct spinlock lock;
+  struct {
+    struct proc *head;         // deque, linked through rqnext/rqprev
+    struct proc *tail;
+  } level[NPRIO];
+  int n;                       // processes on all levels; read unlocked as a hint
+};
+
+static struct runq runq[NCPU];
+
+// Time quantum of each level, in timer ticks.
+static int quantum[NPRIO] = { 1, 2, 4, 8 };
+
+#define BOOSTTICKS 100  // ticks between priority boosts
+
+// Work-stealing hysteresis: only steal from a CPU with at
+// least STEALLOAD processes (running plus queued), and never
+// move a process that was stolen less than STEALDELAY ticks ago.
+#define STEALLOAD  2
+#define STEALDELAY 2
+
+// Sleeping processes, hashed by wait channel, so wakeup only
+// looks at processes that might be sleeping on its channel.
+// Each queue holds the ordinary sleepers first and then the
+// exclusive ones (see sleepexcl).
+#define WAITQBITS 6
+#define NWAITQ (1 << WAITQBITS)
+#define WAITQ(chan) (&waitq[((uint)(chan) * 2654435761U) >> (32 - WAITQBITS)])
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;           // linked through wqnext/wqprev
+  struct proc *tail;
+};
+
+static struct waitq waitq[NWAITQ];
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
-
 void
 pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
+  int i;
+
+  initmcslock(&ptable.lock, "ptable");
+  initrwlock(&ptable.listlock, "ptablelist");
+  slabinit(&ptable.cache, "proccache", sizeof(struct proc));
+  slabinit(&mmcache, "mmcache", sizeof(struct mm));
+  slabinit(&fdtcache, "fdtcache", sizeof(struct fdtable));
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
 }
 
 // Must be called with interrupts disabled
@@ -65,35 +158,388 @@ myproc(void) {
   return p;
 }
 
+// Each process keeps its children on two lists: live ones
+// on p->children and exited ones on p->zombies, so wait and
+// exit only look at the caller's own children.  Caller holds
+// ptable.lock.
+static void
+childpush(struct proc **list, struct proc *p)
+{
+  p->sibprev = 0;
+  p->sibnext = *list;
+  if(*list)
+    (*list)->sibprev = p;
+  *list = p;
+}
+
+static void
+childremove(struct proc **list, struct proc *p)
+{
+  if(p->sibprev)
+    p->sibprev->sibnext = p->sibnext;
+  else
+    *list = p->sibnext;
+  if(p->sibnext)
+    p->sibnext->sibprev = p->sibprev;
+  p->sibnext = p->sibprev = 0;
+}
+
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+// Apply any priority boost p has missed, and p's nice level.
+// Caller holds p->lock, or p is running on this CPU, or p is
+// on a run queue whose lock the caller holds.
+static void
+refresh(struct proc *p)
+{
+  uint epoch;
+
+  epoch = ticks / BOOSTTICKS;
+  if(p->epoch != epoch){
+    p->epoch = epoch;
+    p->prio = 0;
+    p->slice = 0;
+  }
+  if(p->prio < p->nice){
+    p->prio = p->nice;
+    p->slice = 0;
+  }
+}
+
+// Append p to its level of rq.  Caller holds rq->lock.
+static void
+rqinsert(struct runq *rq, struct proc *p)
+{
+  p->rqnext = 0;
+  p->rqprev = rq->level[p->prio].tail;
+  if(p->rqprev)
+    p->rqprev->rqnext = p;
+  else
+    rq->level[p->prio].head = p;
+  rq->level[p->prio].tail = p;
+  rq->n++;
+}
+
+// Unlink p from its level of rq.  Caller holds rq->lock.
+static void
+rqremove(struct runq *rq, struct proc *p)
+{
+  if(p->rqprev)
+    p->rqprev->rqnext = p->rqnext;
+  else
+    rq->level[p->prio].head = p->rqnext;
+  if(p->rqnext)
+    p->rqnext->rqprev = p->rqprev;
+  else
+    rq->level[p->prio].tail = p->rqprev;
+  p->rqnext = p->rqprev = 0;
+  rq->n--;
+}
+
+// Append p to run queue i.  Caller holds p->lock.
+static void
+enqueue(struct proc *p, int i)
+{
+  struct runq *rq = &runq[i];
+
+  refresh(p);
+  p->tqueued = rdtsc();
+  acquire(&rq->lock);
+  p->cpu = i;
+  rqinsert(rq, p);
+  release(&rq->lock);
+}
+
+// Remove and return the first process of the highest
+// non-empty level of run queue i, or 0 if the queue is empty.
 static struct proc*
-allocproc(void)
+dequeue(int i)
 {
+  struct runq *rq = &runq[i];
   struct proc *p;
-  char *sp;
+  int l;
+
+  if(rq->n == 0)
+    return 0;
+  p = 0;
+  acquire(&rq->lock);
+  for(l = 0; l < NPRIO; l++){
+    if((p = rq->level[l].head) != 0){
+      rqremove(rq, p);
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Called by the scheduler on CPU id at each boost: move the
+// processes waiting on its run queue back up.
+static void
+boost(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p, *next;
+  int l;
+
+  acquire(&rq->lock);
+  for(l = 1; l < NPRIO; l++){
+    for(p = rq->level[l].head; p != 0; p = next){
+      next = p->rqnext;
+      rqremove(rq, p);
+      refresh(p);
+      rqinsert(rq, p);
+    }
+  }
+  release(&rq->lock);
+}
+
+// Called by the scheduler on CPU id when its own queue is
+// empty.  Take the process at the tail of the highest level
+// of the busiest other queue, the one that would otherwise
+// wait longest there.  Returns 0 if no CPU is busy enough to
+// be worth robbing.
+static struct proc*
+steal(int id)
+{
+  struct runq *rq;
+  struct proc *p;
+  int i, l, victim, load, maxload;
+
+  victim = -1;
+  maxload = STEALLOAD - 1;
+  for(i = 0; i < ncpu; i++){
+    if(i == id || runq[i].n == 0)
+      continue;
+    load = runq[i].n + (cpus[i].proc != 0);
+    if(load > maxload){
+      victim = i;
+      maxload = load;
+    }
+  }
+  if(victim < 0)
+    return 0;
+
+  rq = &runq[victim];
+  acquire(&rq->lock);
+  p = 0;
+  for(l = 0; l < NPRIO && p == 0; l++)
+    p = rq->level[l].tail;
+  if(p == 0 || rq->n + (cpus[victim].proc != 0) < STEALLOAD ||
+     ticks - p->stolen < STEALDELAY){
+    release(&rq->lock);
+    return 0;
+  }
+  rqremove(rq, p);
+  p->stolen = ticks;
+  release(&rq->lock);
+  trace(TR_STEAL, p->pid);
+  return p;
+}
+
+// Choose a run queue for p: the least loaded CPU, preferring
+// the one p last ran on, whose cache may still be warm.
+static int
+pickcpu(struct proc *p)
+{
+  int i, best, load, bestload;
+
+  best = p->cpu;
+  bestload = runq[best].n + (cpus[best].proc != 0);
+  for(i = 0; i < ncpu && bestload > 0; i++){
+    load = runq[i].n + (cpus[i].proc != 0);
+    if(load < bestload){
+      best = i;
+      bestload = load;
+    }
+  }
+  return best;
+}
+
+// Mark p RUNNABLE and put it on a run queue.
+// Caller holds p->lock.
+static void
+makerunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  enqueue(p, pickcpu(p));
+}
+
+// Charge the current timer tick to the running process.
+// Returns 1 if it should yield the CPU: it has used up its
+// quantum, and drops a level, or a process of higher priority
+// is waiting on this CPU.  Called from trap() with interrupts
+// disabled.
+int
+timeslice(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq;
+  int l;
+
+  p->runticks++;
+  refresh(p);
+  if(++p->slice >= quantum[p->prio]){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->slice = 0;
+    return 1;
+  }
+  rq = &runq[cpuid()];
+  for(l = 0; l < p->prio; l++)
+    if(rq->level[l].head)
+      return 1;
+  return 0;
+}
+
+// Allocate an empty address space with one reference.
+struct mm*
+mmalloc(void)
+{
+  struct mm *mm;
+
+  if((mm = slaballoc(&mmcache)) == 0)
+    return 0;
+  memset(mm, 0, sizeof(*mm));
+  initsleeplock(&mm->lock, "mm");
+  mm->ref = 1;
+  return mm;
+}
+
+// Drop a reference to mm, freeing it with the last one.
+void
+mmput(struct mm *mm)
+{
+  int last;
 
   acquire(&ptable.lock);
+  last = --mm->ref == 0;
+  release(&ptable.lock);
+  if(!last)
+    return;
+  if(mm->pgdir)
+    freevm(mm->pgdir);
+  if(mm->sink)
+    kfree(mm->sink);
+  free_mmap_ll(mm);
+  slabfree(&mmcache, mm);
+}
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
+// Allocate a copy of fdt, or an empty table if fdt is 0,
+// with one reference.
+static struct fdtable*
+fdtdup(struct fdtable *fdt)
+{
+  struct fdtable *nfdt;
+  int fd;
 
+  if((nfdt = slaballoc(&fdtcache)) == 0)
+    return 0;
+  memset(nfdt, 0, sizeof(*nfdt));
+  initlock(&nfdt->lock, "fdtable");
+  nfdt->ref = 1;
+  if(fdt){
+    acquire(&fdt->lock);
+    for(fd = 0; fd < NOFILE; fd++)
+      if(fdt->ofile[fd])
+        nfdt->ofile[fd] = filedup(fdt->ofile[fd]);
+    release(&fdt->lock);
+  }
+  return nfdt;
+}
+
+// Drop a reference to fdt; the last one closes its files.
+static void
+fdtput(struct fdtable *fdt)
+{
+  int fd, last;
+
+  acquire(&ptable.lock);
+  last = --fdt->ref == 0;
   release(&ptable.lock);
+  if(!last)
+    return;
+  for(fd = 0; fd < NOFILE; fd++)
+    if(fdt->ofile[fd])
+      fileclose(fdt->ofile[fd]);
+  slabfree(&fdtcache, fdt);
+}
+
+// Free p, which is UNUSED or EMBRYO and on no other list
+// but the process list and pid hash.  Caller holds ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  if(p->kstack)
+    kfree(p->kstack);
+  acquirewrite(&ptable.listlock);
+  if(p->allprev)
+    p->allprev->allnext = p->allnext;
+  else
+    ptable.list = p->allnext;
+  if(p->allnext)
+    p->allnext->allprev = p->allprev;
+  for(pp = PIDHASH(p->pid); *pp != p; pp = &(*pp)->pidnext)
+    ;
+  *pp = p->pidnext;
+  releasewrite(&ptable.listlock);
+  slabfree(&ptable.cache, p);
+}
+
+// Return the live process with the given pid, or 0.
+// Caller holds ptable.lock or ptable.listlock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = *PIDHASH(pid); p != 0; p = p->pidnext)
+    if(p->pid == pid && p->state != UNUSED)
+      return p;
   return 0;
+}
+
+//PAGEBREAK: 32
+// Allocate a proc, in state EMBRYO, and initialize
+// state required to run in the kernel.
+// Otherwise return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+  struct proc **h;
+  char *sp;
+
+  acquire(&ptable.lock);
 
-found:
+  if((p = slaballoc(&ptable.cache)) == 0){
+    release(&ptable.lock);
+    return 0;
+  }
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->epoch = ticks / BOOSTTICKS;
+
+  acquirewrite(&ptable.listlock);
+  p->allnext = ptable.list;
+  if(ptable.list)
+    ptable.list->allprev = p;
+  ptable.list = p;
+  h = PIDHASH(p->pid);
+  p->pidnext = *h;
+  *h = p;
+  releasewrite(&ptable.listlock);
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -126,10 +572,11 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->mm = mmalloc()) == 0 || (p->fdt = fdtdup(0)) == 0 ||
+     (p->mm->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  inituvm(p->mm->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  p->mm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -146,11 +593,11 @@ userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
-  p->state = RUNNABLE;
+  makerunnable(p);
 
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
@@ -160,29 +607,56 @@ growproc(int n)
 {
   uint sz;
   struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
 
-  sz = curproc->sz;
+  sz = mm->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(mm->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = shrinkuvm(curproc, sz, sz + n)) == 0)
       return -1;
   }
-  curproc->sz = sz;
+  mm->sz = sz;
   switchuvm(curproc);
   return 0;
 }
 
+// Make np, a new child of the current process, runnable.
+// Returns its pid.
+static int
+launch(struct proc *np)
+{
+  struct proc *curproc = myproc();
+  int pid;
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->parent = curproc;
+  childpush(&curproc->children, np);
+  release(&ptable.lock);
+
+  acquire(&np->lock);
+
+  np->cpu = curproc->cpu;
+  np->nice = curproc->nice;
+  makerunnable(np);
+
+  release(&np->lock);
+
+  return pid;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
 int
 fork(void)
 {
-  int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
 
   // Allocate process.
   if((np = allocproc()) == 0){
@@ -190,35 +664,81 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
-    return -1;
+  if((np->mm = mmalloc()) == 0)
+    goto bad;
+  acquiresleep(&mm->lock);
+  if((np->mm->pgdir = copyuvm(mm->pgdir, mm->sz)) == 0 ||
+     dup_mmap_ll(np->mm, mm) < 0){
+    releasesleep(&mm->lock);
+    goto bad;
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
+  np->mm->sz = mm->sz;
+  releasesleep(&mm->lock);
+  if((np->fdt = fdtdup(curproc->fdt)) == 0)
+    goto bad;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
-  pid = np->pid;
+  return launch(np);
 
+ bad:
+  if(np->mm)
+    mmput(np->mm);
   acquire(&ptable.lock);
+  freeproc(np);
+  release(&ptable.lock);
+  return -1;
+}
 
-  np->state = RUNNABLE;
+// Create a thread: a new process that shares the caller's
+// address space and open files and starts at fn(arg) on the
+// page of user stack at stack.  fn must not return.
+// Returns the new thread's pid, or -1.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  struct proc *np;
+  struct proc *curproc = myproc();
+  uint sp, ustack[2];
+
+  if(stack == 0 || (uint)stack % PGSIZE != 0 ||
+     (uint)stack + PGSIZE > curproc->mm->sz)
+    return -1;
 
+  if((np = allocproc()) == 0)
+    return -1;
+
+  ustack[0] = 0xffffffff;  // fake return PC
+  ustack[1] = (uint)arg;
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  if(copyout(curproc->mm->pgdir, sp, ustack, sizeof(ustack)) < 0){
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+
+  *np->tf = *curproc->tf;
+  np->tf->eip = (uint)fn;
+  np->tf->esp = sp;
+  np->ustack = stack;
+  np->cwd = idup(curproc->cwd);
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  acquire(&ptable.lock);
+  np->mm = curproc->mm;
+  np->mm->ref++;
+  np->fdt = curproc->fdt;
+  np->fdt->ref++;
   release(&ptable.lock);
 
-  return pid;
+  return launch(np);
 }
 
 // Exit the current process.  Does not return.
@@ -229,18 +749,13 @@ exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+  // Close all open files, unless other threads use them.
+  fdtput(curproc->fdt);
+  curproc->fdt = 0;
 
   begin_op();
   iput(curproc->cwd);
@@ -250,67 +765,119 @@ exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
-
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
+  childremove(&curproc->parent->children, curproc);
+  childpush(&curproc->parent->zombies, curproc);
+  wakeup(curproc->parent);
+
+  // Pass abandoned children to init.  init only wait()s, so
+  // abandoned threads become ordinary processes to it.
+  while((p = curproc->children) != 0){
+    childremove(&curproc->children, p);
+    p->parent = initproc;
+    p->ustack = 0;
+    childpush(&initproc->children, p);
+  }
+  if(curproc->zombies){
+    while((p = curproc->zombies) != 0){
+      childremove(&curproc->zombies, p);
       p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+      p->ustack = 0;
+      childpush(&initproc->zombies, p);
     }
+    wakeup(initproc);
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return.  wait() will
+  // not free this process until the scheduler releases
+  // curproc->lock, after we have switched off our stack.
+  acquire(&curproc->lock);
   curproc->state = ZOMBIE;
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int
-wait(void)
+// Is p a thread, as opposed to a process?
+#define ISTHREAD(p) ((p)->ustack != 0)
+
+// Free an exited child: a thread if threads is set, else a
+// process.  The address space goes when its last thread does.
+static int
+reap(int threads, void **stack)
 {
   struct proc *p;
-  int havekids, pid;
+  struct mm *mm;
+  int pid;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        release(&ptable.lock);
-        return pid;
-      }
+    for(p = curproc->zombies; p != 0; p = p->sibnext)
+      if(ISTHREAD(p) == threads)
+        break;
+    if(p != 0){
+      // Found one.  Wait until it is off its stack.
+      childremove(&curproc->zombies, p);
+      acquire(&p->lock);
+      pid = p->pid;
+      if(stack)
+        *stack = p->ustack;
+      mm = p->mm;
+      p->state = UNUSED;
+      release(&p->lock);
+      freeproc(p);
+      release(&ptable.lock);
+      mmput(mm);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
+    for(p = curproc->children; p != 0; p = p->sibnext)
+      if(ISTHREAD(p) == threads)
+        break;
+    if(p == 0 || curproc->killed){
       release(&ptable.lock);
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
 }
 
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  return reap(0, 0);
+}
+
+// Wait for a thread created by this process (see clone) to
+// exit and return its pid, with its user stack in *stack.
+// Return -1 if this process has no threads.
+int
+join(void **stack)
+{
+  return reap(1, stack);
+}
+
+// Record how long p waited on a run queue, by priority level.
+// Caller holds p->lock.
+static void
+schedlatency(struct proc *p)
+{
+  struct schedstat *st;
+  uint64 t;
+
+  t = rdtsc() - p->tqueued;
+  st = &p->lat[p->prio];
+  st->n++;
+  st->sum += t;
+  if(t > st->max)
+    st->max = t;
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -324,38 +891,50 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  uint epoch = 0;
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+    if(ticks / BOOSTTICKS != epoch){
+      epoch = ticks / BOOSTTICKS;
+      boost(id);
     }
-    release(&ptable.lock);
 
+    // Take the next process from this CPU's run queue,
+    // or if there is none, from a busier CPU's.
+    if((p = dequeue(id)) == 0 && (p = steal(id)) == 0)
+      continue;
+
+    // Switch to chosen process.  It is the process's job
+    // to release p->lock and then reacquire it
+    // before jumping back to us.  A stolen process may
+    // still be switching out on its old CPU; acquiring
+    // p->lock waits for that to finish.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    p->cpu = id;
+    schedlatency(p);
+    c->proc = p;
+    switchuvm(p);
+    p->state = RUNNING;
+
+    trace(TR_SWITCH, p->pid);
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -368,8 +947,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&p->lock))
+    panic("sched p->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -385,10 +964,13 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&p->lock);  //DOC: yieldlock
+  p->state = RUNNABLE;
+  enqueue(p, cpuid());
   sched();
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -397,8 +979,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -412,65 +994,156 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
-// Atomically release lock and sleep on chan.
-// Reacquires lock when awakened.
-void
-sleep(void *chan, struct spinlock *lk)
+// Add p to the tail of wq if p sleeps exclusively, else
+// after the last ordinary sleeper.  Caller holds wq->lock.
+static void
+wqinsert(struct waitq *wq, struct proc *p)
+{
+  struct proc *q;
+
+  q = wq->tail;
+  if(!p->excl)
+    while(q && q->excl)
+      q = q->wqprev;
+  // p goes after q, or first if q is 0.
+  p->wqprev = q;
+  p->wqnext = q ? q->wqnext : wq->head;
+  if(p->wqnext)
+    p->wqnext->wqprev = p;
+  else
+    wq->tail = p;
+  if(q)
+    q->wqnext = p;
+  else
+    wq->head = p;
+  p->wq = wq;
+}
+
+// Caller holds wq->lock.
+static void
+wqremove(struct waitq *wq, struct proc *p)
+{
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  else
+    wq->tail = p->wqprev;
+  p->wqnext = p->wqprev = 0;
+  p->wq = 0;
+}
+
+static void
+sleep1(void *chan, struct spinlock *lk, int excl)
 {
   struct proc *p = myproc();
-  
+  struct waitq *wq;
+
   if(p == 0)
     panic("sleep");
 
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
+  // Join chan's wait queue and mark p SLEEPING before
+  // releasing lk.  A wakeup(chan) must come from a holder of
+  // lk, so it will find p; holding p->lock until sched keeps
+  // it from running p until p is off this CPU.
+  wq = WAITQ(chan);
+  acquire(&wq->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
   p->chan = chan;
+  p->excl = excl;
   p->state = SLEEPING;
+  wqinsert(wq, p);
+  release(lk);
+  release(&wq->lock);
 
   sched();
 
-  // Tidy up.
+  release(&p->lock);  //DOC: sleeplock2
+
+  // wakeup took p off the queue, but kill does not.
+  if(p->wq){
+    acquire(&wq->lock);
+    if(p->wq)
+      wqremove(wq, p);
+    release(&wq->lock);
+  }
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);
+}
+
+// Atomically release lock and sleep on chan.
+// Reacquires lock when awakened.
+void
+sleep(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 0);
+}
+
+// Like sleep, but wakeup(chan) wakes only one exclusive
+// sleeper, after all the ordinary ones.  For waiters of which
+// only one can make progress; a woken waiter that leaves the
+// condition true for others must call wakeup(chan) again.
+void
+sleepexcl(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 1);
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
+// Wake up all ordinary processes sleeping on chan and up to
+// n exclusive ones.  Returns the number of processes woken.
+// Caller holds the lock that the sleepers passed to sleep,
+// and no p->lock.
+int
+wakeupn(void *chan, int n)
 {
-  struct proc *p;
+  struct waitq *wq;
+  struct proc *p, *next;
+  int nexcl, woke, excl;
+
+  // Sleepers join the queue while holding the caller's
+  // lock, so an empty queue here means nobody to wake.
+  wq = WAITQ(chan);
+  if(wq->head == 0)
+    return 0;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  woke = 0;
+  nexcl = 0;
+  acquire(&wq->lock);
+  for(p = wq->head; p != 0; p = next){
+    next = p->wqnext;
+    if(p->chan != chan)
+      continue;
+    if(p->excl && nexcl >= n)
+      break;
+    wqremove(wq, p);
+    acquire(&p->lock);
+    excl = p->excl;
+    if(p->state == SLEEPING){
+      makerunnable(p);
+      woke++;
+      if(excl)
+        nexcl++;
+    }
+    release(&p->lock);
+  }
+  release(&wq->lock);
+  return woke;
 }
 
-// Wake up all processes sleeping on chan.
+// Wake up all ordinary processes sleeping on chan and
+// the first exclusive one.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  wakeupn(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -481,19 +1154,81 @@ kill(int pid)
 {
   struct proc *p;
 
+  // Hold ptable.lock, not just listlock: wait() checks killed
+  // under it before sleeping, and must not miss this.
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
   }
+  acquire(&p->lock);
+  p->killed = 1;
+  // Wake process from sleep if necessary.
+  if(p->state == SLEEPING)
+    makerunnable(p);
+  release(&p->lock);
   release(&ptable.lock);
-  return -1;
+  return 0;
+}
+
+// Set the nice level of process pid (0 means the caller):
+// it will not be scheduled above priority level, so batch
+// jobs can be kept below interactive ones.  Children inherit
+// the level.  Returns the old level, or -1.
+int
+nice(int pid, int level)
+{
+  struct proc *p;
+  int old;
+
+  if(level < 0 || level >= NPRIO)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  acquireread(&ptable.listlock);
+  if((p = findproc(pid)) == 0){
+    releaseread(&ptable.listlock);
+    return -1;
+  }
+  acquire(&p->lock);
+  old = p->nice;
+  p->nice = level;
+  release(&p->lock);
+  releaseread(&ptable.listlock);
+  return old;
+}
+
+// Copy information about up to n processes into dst.
+// Returns the number copied.
+int
+getpinfo(struct pinfo *dst, int n)
+{
+  struct proc *p;
+  int i, m;
+
+  m = 0;
+  acquireread(&ptable.listlock);
+  for(p = ptable.list; p != 0 && m < n; p = p->allnext){
+    acquire(&p->lock);
+    if(p->state != UNUSED){
+      dst[m].pid = p->pid;
+      dst[m].state = p->state;
+      safestrcpy(dst[m].name, p->name, sizeof(dst[m].name));
+      dst[m].prio = p->prio;
+      dst[m].nice = p->nice;
+      dst[m].cpu = p->cpu;
+      dst[m].runticks = p->runticks;
+      for(i = 0; i < NPRIO; i++){
+        dst[m].lat[i].n = p->lat[i].n;
+        dst[m].lat[i].sum = p->lat[i].sum;
+        dst[m].lat[i].max = p->lat[i].max;
+      }
+      m++;
+    }
+    release(&p->lock);
+  }
+  releaseread(&ptable.listlock);
+  return m;
 }
 
 //PAGEBREAK: 36
@@ -516,14 +1251,14 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.list; p != 0; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
+    cprintf("%d %s %d %s", p->pid, state, p->prio, p->name);
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
@@ -8,6 +8,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint tlbreq;        // TLB flushes requested (see tlbshootdown)
+  volatile uint tlbdone;       // tlbreq as of the last flush
 };
 
 extern struct cpu cpus[NCPU];
@@ -49,23 +51,60 @@ typedef struct mmapped_region
   int fd;          //file descriptor (-1 for anonymous allocation)
 } mmapped_region;
 
+// Open file table, shared by the threads of a process.
+struct fdtable {
+  struct spinlock lock;        // protects ofile
+  int ref;                     // threads using it; protected by ptable.lock
+  struct file *ofile[NOFILE];  // Open files
+};
+
+// Scheduling latency at one priority level: time between
+// becoming RUNNABLE and starting to run, in TSC cycles.
+struct schedstat {
+  uint n;
+  uint64 sum;
+  uint64 max;
+};
+
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
+  struct spinlock lock;        // protects state and chan (see proc.c)
+  struct mm *mm;               // Address space (see mm.h)
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
+  struct proc *allnext;        // next on the list of all processes
+  struct proc *allprev;        // previous on that list
+  struct proc *pidnext;        // next on p's pid hash chain
   struct proc *parent;         // Parent process
+  struct proc *children;       // live children, linked through sibnext
+  struct proc *zombies;        // exited children not yet waited for
+  struct proc *sibnext;        // next child on the parent's list
+  struct proc *sibprev;        // previous child on the parent's list
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct waitq *wq;            // wait queue p is on, or 0
+  struct proc *wqnext;         // next process on that wait queue
+  struct proc *wqprev;         // previous process on that wait queue
+  int excl;                    // woken one at a time (see sleepexcl)
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
+  int notrace;                 // trace() ignores p's events (see tracectl)
+  struct fdtable *fdt;         // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  int nregions;                // number of allocated regions
-  mmapped_region *region_head; // head of mapped region list
+  void *ustack;                // clone(): the thread's user stack
+  int cpu;                     // CPU whose run queue p is on, or last ran on
+  struct proc *rqnext;         // next process on that run queue
+  struct proc *rqprev;         // previous process on that run queue
+  uint stolen;                 // ticks when last stolen by another CPU
+  int prio;                    // MLFQ level, 0 is highest
+  int nice;                    // highest level p may run at (see nice())
+  int slice;                   // ticks used of the current level's quantum
+  uint epoch;                  // last priority boost applied to p
+  uint64 tqueued;              // rdtsc() when p was last made RUNNABLE
+  uint runticks;               // timer ticks charged to p
+  struct schedstat lat[NPRIO]; // run queue wait, by level
 };
 
 // Process memory is laid out contiguously, low addresses first:
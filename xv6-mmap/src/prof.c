@@ -0,0 +1,162 @@
+// Sampling CPU profiler.
+//
+// While profiling is on, every CPU records the interrupted eip
+// and a short frame-pointer call chain on each timer interrupt.
+// The kernel and user programs are built with
+// -fno-omit-frame-pointer, so the %ebp chain is reliable.
+// Each CPU owns a queue of samples; the timer interrupt is the
+// only producer and profread the only consumer, so neither
+// side needs a lock.  If the reader falls behind, new samples
+// are dropped and counted.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "prof.h"
+
+#define NPROFSAMPLE 256  // samples per CPU; must be a power of 2
+
+struct profqueue {
+  volatile uint head;  // next slot the owning CPU fills
+  volatile uint tail;  // next slot the reader empties
+  uint dropped;        // samples lost to a full queue
+  struct profsample s[NPROFSAMPLE];
+};
+
+static struct profqueue queues[NCPU];
+static struct spinlock readlock;  // serializes readers
+int profiling;                    // sample while non-zero
+
+void
+profinit(void)
+{
+  initlock(&readlock, "prof");
+}
+
+// Follow the %ebp chain from ebp, storing return addresses in
+// pc[1..].  Kernel chains must stay above KERNBASE; user chains
+// must stay inside the process image and move up the stack.
+static void
+callchain(uint *pc, uint ebp, int user, uint sz)
+{
+  uint *fp;
+  int i;
+
+  for(i = 1; i < PROFDEPTH; i++){
+    if(ebp == 0 || ebp % 4 != 0)
+      break;
+    if(user && ebp + 8 > sz)
+      break;
+    if(!user && (ebp < KERNBASE || ebp == 0xffffffff))
+      break;
+    fp = (uint*)ebp;
+    pc[i] = fp[1];     // saved %eip
+    if(fp[0] <= ebp)   // callers' frames are higher up
+      ebp = 0;
+    else
+      ebp = fp[0];     // saved %ebp
+  }
+  for(; i < PROFDEPTH; i++)
+    pc[i] = 0;
+}
+
+// Record a sample of the code interrupted by tf.
+// Called from trap() on every timer interrupt, interrupts off.
+void
+profsample(struct trapframe *tf)
+{
+  struct profqueue *q;
+  struct profsample *s;
+  struct proc *p;
+
+  if(!profiling)
+    return;
+
+  q = &queues[cpuid()];
+  if(q->head - q->tail == NPROFSAMPLE){
+    __sync_fetch_and_add(&q->dropped, 1);
+    return;
+  }
+  s = &q->s[q->head & (NPROFSAMPLE-1)];
+  p = myproc();
+  if(p){
+    safestrcpy(s->name, p->name, sizeof(s->name));
+    s->pid = p->pid;
+  } else {
+    s->name[0] = 0;
+    s->pid = 0;
+  }
+  s->cpu = cpuid();
+  s->user = (tf->cs&3) == DPL_USER;
+  s->pc[0] = tf->eip;
+  callchain(s->pc, tf->ebp, s->user, p ? p->mm->sz : 0);
+  // Publish the sample before advancing head.
+  __sync_synchronize();
+  q->head++;
+}
+
+// Turn profiling on (on > 0) or off (on == 0) and return the
+// previous setting; on < 0 just returns the current setting.
+// Turning profiling on discards samples not yet read.
+int
+profctl(int on)
+{
+  int i, old;
+
+  acquire(&readlock);
+  old = profiling;
+  if(on > 0 && !profiling){
+    for(i = 0; i < ncpu; i++){
+      queues[i].tail = queues[i].head;
+      queues[i].dropped = 0;
+    }
+    profiling = 1;
+  } else if(on == 0)
+    profiling = 0;
+  release(&readlock);
+  return old;
+}
+
+// Copy up to n samples into dst, preceded by a drop record for
+// each CPU that lost samples.  Returns the number copied.
+int
+profread(struct profsample *dst, int n)
+{
+  struct profqueue *q;
+  uint head, dropped;
+  int c, m;
+
+  m = 0;
+  acquire(&readlock);
+  for(c = 0; c < ncpu && m < n; c++){
+    q = &queues[c];
+    dropped = q->dropped;
+    if(dropped){
+      memset(&dst[m], 0, sizeof(dst[m]));
+      safestrcpy(dst[m].name, "dropped", sizeof(dst[m].name));
+      dst[m].pid = -1;
+      dst[m].cpu = c;
+      dst[m].pc[0] = dropped;
+      m++;
+      // The owning CPU may drop more while we look;
+      // only subtract what was reported.
+      __sync_fetch_and_sub(&q->dropped, dropped);
+    }
+    head = q->head;
+    __sync_synchronize();
+    while(q->tail != head && m < n){
+      dst[m++] = q->s[q->tail & (NPROFSAMPLE-1)];
+      __sync_synchronize();
+      q->tail++;
+    }
+  }
+  release(&readlock);
+  return m;
+}
@@ -0,0 +1,14 @@
+// Sampling profiler records, taken by profsample() in prof.c on
+// every timer interrupt and read out by the profread system call.
+
+#define PROFDEPTH 8   // program counters kept per sample
+
+struct profsample {
+  char name[16];        // process name, empty if the CPU was idle
+  int pid;              // process id, 0 if idle; -1 marks a drop record
+  ushort cpu;           // CPU that took the sample
+  ushort user;          // 1 if user code was interrupted
+  uint pc[PROFDEPTH];   // interrupted eip, then return addresses;
+                        // zero-terminated if shorter.  For a drop
+                        // record, pc[0] is the number of samples lost.
+};
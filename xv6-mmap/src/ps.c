@@ -0,0 +1,50 @@
+// List processes and their scheduling statistics.
+//
+// One line per process: pid, state, priority level (0 is
+// highest), nice level, CPU, timer ticks run and name, then
+// for each level it has been dispatched at, the run queue
+// wait as lat<level>=<count>/<mean>/<max> in TSC cycles.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pinfo.h"
+
+static char *states[] = {
+  "unused", "embryo", "sleep", "runble", "run", "zombie"
+};
+
+int
+main(void)
+{
+  struct pinfo *info, *p;
+  char *state;
+  int i, n, max;
+
+  // There is no fixed limit on processes; grow the
+  // buffer until everything fits.
+  for(max = 64; ; max *= 2){
+    if((info = malloc(max * sizeof(*info))) == 0){
+      printf(2, "ps: out of memory\n");
+      exit();
+    }
+    if((n = getpinfo(info, max)) < max)
+      break;
+    free(info);
+  }
+  printf(1, "pid state prio nice cpu ticks name\n");
+  for(p = info; p < &info[n]; p++){
+    state = "???";
+    if(p->state >= 0 && p->state < sizeof(states)/sizeof(states[0]))
+      state = states[p->state];
+    printf(1, "%d %s %d %d %d %d %s", p->pid, state, p->prio,
+           p->nice, p->cpu, p->runticks, p->name);
+    for(i = 0; i < NPRIO; i++)
+      if(p->lat[i].n > 0)
+        printf(1, " lat%d=%d/%l/%l", i, p->lat[i].n,
+               udiv64(p->lat[i].sum, p->lat[i].n), p->lat[i].max);
+    printf(1, "\n");
+  }
+  exit();
+}
@@ -0,0 +1,141 @@
+// Slab allocator for fixed-size kernel objects.
+//
+// A cache hands out objects of one size, carved from whole
+// pages (slabs) taken from kalloc.  Each slab starts with a
+// struct slab header followed by its objects; free objects
+// are linked through their first word.  Freeing an object
+// finds its slab by rounding the address down to a page.
+// A slab whose objects are all free goes back to kalloc,
+// unless it is the cache's only slab with room.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct slabcache *cache;
+  struct slab *next;         // on cache's partial or full list
+  struct slab *prev;
+  void *free;                // free objects
+  uint inuse;
+};
+
+struct object {
+  struct object *next;
+};
+
+void
+slabinit(struct slabcache *c, char *name, uint size)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / c->size;
+  if(c->perslab == 0)
+    panic("slabinit: object too big");
+  c->partial = 0;
+  c->full = 0;
+  c->nslab = 0;
+  c->nalloc = 0;
+}
+
+static void
+push(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(s->next)
+    s->next->prev = s;
+  *list = s;
+}
+
+static void
+unlink(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Take a page for a new slab and put it on c->partial.
+// Caller holds c->lock.
+static struct slab*
+grow(struct slabcache *c)
+{
+  struct slab *s;
+  struct object *o;
+  char *a;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->free = 0;
+  s->inuse = 0;
+  a = (char*)(s + 1);
+  for(i = c->perslab - 1; i >= 0; i--){
+    o = (struct object*)(a + i*c->size);
+    o->next = s->free;
+    s->free = o;
+  }
+  push(&c->partial, s);
+  c->nslab++;
+  return s;
+}
+
+// Allocate one object, or return 0 if out of memory.
+// The object's contents are undefined.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct slab *s;
+  struct object *o;
+
+  acquire(&c->lock);
+  if((s = c->partial) == 0 && (s = grow(c)) == 0){
+    release(&c->lock);
+    return 0;
+  }
+  o = s->free;
+  s->free = o->next;
+  if(++s->inuse == c->perslab){
+    unlink(&c->partial, s);
+    push(&c->full, s);
+  }
+  c->nalloc++;
+  release(&c->lock);
+  return o;
+}
+
+void
+slabfree(struct slabcache *c, void *v)
+{
+  struct slab *s;
+  struct object *o;
+
+  s = (struct slab*)PGROUNDDOWN((uint)v);
+  if(s->cache != c)
+    panic("slabfree");
+  o = v;
+
+  acquire(&c->lock);
+  o->next = s->free;
+  s->free = o;
+  if(s->inuse-- == c->perslab){
+    unlink(&c->full, s);
+    push(&c->partial, s);
+  }
+  c->nalloc--;
+  if(s->inuse == 0 && (s->next || s->prev)){
+    unlink(&c->partial, s);
+    c->nslab--;
+    kfree((char*)s);
+  }
+  release(&c->lock);
+}
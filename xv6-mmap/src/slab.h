@@ -0,0 +1,11 @@
+// A cache of equal-sized kernel objects (see slab.c).
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;                 // object size, rounded up
+  uint perslab;              // objects per slab page
+  struct slab *partial;      // slabs with free objects
+  struct slab *full;         // slabs with none
+  uint nslab;                // pages held
+  uint nalloc;               // objects in use
+};
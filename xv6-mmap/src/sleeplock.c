@@ -6,38 +6,159 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
+// Adaptive spinning.  A sleep lock is often held only briefly,
+// by a process running on another CPU; sleeping costs two
+// trips through the scheduler, while the holder is likely to
+// release the lock within microseconds.  So a waiter first
+// spins, for at most SPINCYCLES in all, as long as the holder
+// is running, and sleeps only if that fails.
+#define SPINCYCLES 20000
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
   lk->pid = 0;
+  lk->owner = 0;
+#ifdef LOCKSTAT
+  lk->class = lockclassof(name);
+#endif
+}
+
+// Spin while lk's exclusive holder is running on another CPU,
+// until it releases lk or *budget cycles are gone.  Caller
+// holds lk->lk, which this drops while spinning and retakes.
+// Returns 0 if it did not spin, so the caller should sleep.
+//
+// The holder may exit and be freed while we look at it; proc
+// memory stays mapped, so the worst case is a wrong guess.
+static int
+spin(struct sleeplock *lk, int *budget)
+{
+  struct proc *owner;
+  uint64 t0;
+
+  owner = lk->owner;
+  if(*budget <= 0 || owner == 0 || owner == myproc() ||
+     owner->state != RUNNING)
+    return 0;
+  release(&lk->lk);
+  t0 = rdtsc();
+  while(*(volatile struct proc**)&lk->owner == owner &&
+        *(volatile enum procstate*)&owner->state == RUNNING &&
+        rdtsc() - t0 < *budget)
+    pause();
+  *budget -= rdtsc() - t0;
+  acquire(&lk->lk);
+  return 1;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int budget = SPINCYCLES;
+#ifdef LOCKSTAT
+  int contended = 0, slept = 0;
+  uint64 t0 = rdtsc();
+#endif
+
   acquire(&lk->lk);
-  while (lk->locked) {
+  lk->wwait++;
+  while (lk->locked || lk->readers) {
+#ifdef LOCKSTAT
+    contended = 1;
+#endif
+    if(spin(lk, &budget))
+      continue;
+#ifdef LOCKSTAT
+    slept = 1;
+#endif
     sleep(lk, &lk->lk);
   }
+  lk->wwait--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+#ifdef LOCKSTAT
+  lk->tacquire = rdtsc();
+  lockacquired(lk->class, contended, slept, lk->tacquire - t0);
+#endif
+  release(&lk->lk);
+}
+
+// Acquire lk shared with other readers.  Waits while a writer
+// holds lk or waits for it, so readers cannot starve writers.
+// A reader must not take the same lock shared twice: a writer
+// arriving in between would wait for the first hold, and the
+// second would wait for the writer.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  int budget = SPINCYCLES;
+#ifdef LOCKSTAT
+  int contended = 0, slept = 0;
+  uint64 t0 = rdtsc();
+#endif
+
+  acquire(&lk->lk);
+  while (lk->locked || lk->wwait) {
+#ifdef LOCKSTAT
+    contended = 1;
+#endif
+    if(spin(lk, &budget))
+      continue;
+#ifdef LOCKSTAT
+    slept = 1;
+#endif
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+#ifdef LOCKSTAT
+  lockacquired(lk->class, contended, slept, rdtsc() - t0);
+#endif
   release(&lk->lk);
 }
 
+// Release lk, held either exclusively or shared.
 void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  lk->locked = 0;
+  if(lk->locked){
+#ifdef LOCKSTAT
+    lockreleased(lk->class, rdtsc() - lk->tacquire);
+#endif
+    lk->locked = 0;
+    lk->pid = 0;
+    lk->owner = 0;
+  } else if(lk->readers > 0)
+    lk->readers--;
+  else
+    panic("releasesleep");
+  if(lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Give up ownership of lk but not lk itself, which stays held
+// by no process until someone calls releasesleep: for example
+// a disk interrupt finishing a request the holder started.
+void
+disownsleep(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(!lk->locked || lk->pid != myproc()->pid)
+    panic("disownsleep");
   lk->pid = 0;
-  wakeup(lk);
+  lk->owner = 0;
   release(&lk->lk);
 }
 
@@ -52,5 +173,15 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Is lk held at all, exclusively or shared?  Shared holders
+// are not recorded, so this cannot say whether we are one.
+int
+lockedsleep(struct sleeplock *lk)
+{
+  int r;
 
-
+  acquire(&lk->lk);
+  r = lk->locked || lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
@@ -1,10 +1,17 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Number of shared holders
+  int wwait;         // Exclusive waiters, which hold off new readers
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
-  int pid;           // Process holding lock
+  int pid;           // Process holding lock exclusively
+  struct proc *owner; // Same, for adaptive spinning
+#ifdef LOCKSTAT
+  struct lockclass *class; // Statistics shared by locks with this name.
+  uint64 tacquire;   // When the holder acquired the lock.
+#endif
 };
 
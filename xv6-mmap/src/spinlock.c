@@ -6,15 +6,195 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+
+#ifdef LOCKSTAT
+#define NLOCKCLASS 64
+
+// Statistics for all locks that share a name.  Each CPU updates
+// only its own counters, with interrupts off, so the counters
+// need no lock of their own.
+struct lockclass {
+  char *name;
+  struct {
+    uint64 nacquire;
+    uint64 ncontend;
+    uint64 nsleep;
+    uint64 spincycles;
+    uint64 maxhold;
+  } cpu[NCPU];
+};
+
+static struct lockclass lockclass[NLOCKCLASS];
+static int nlockclass;
+static uint classlock;  // guards adding classes; see lookupclass()
+
+// Find or create the statistics entry for name.  Called from
+// initlock(), which may run before mycpu() works, so it
+// guards the table with a bare xchg rather than a spinlock.
+static struct lockclass*
+lookupclass(char *name)
+{
+  struct lockclass *c;
+
+  while(xchg(&classlock, 1) != 0)
+    ;
+  for(c = lockclass; c < &lockclass[nlockclass]; c++)
+    if(strncmp(c->name, name, 16) == 0)
+      goto found;
+  if(nlockclass == NLOCKCLASS){
+    c = 0;
+    goto found;
+  }
+  c = &lockclass[nlockclass++];
+  c->name = name;
+found:
+  xchg(&classlock, 0);
+  return c;
+}
+
+// Sleep locks keep statistics in the same table, through
+// these three (see sleeplock.c).
+struct lockclass*
+lockclassof(char *name)
+{
+  return lookupclass(name);
+}
+
+// Count an acquisition of a lock of class c that waited
+// cycles in all, spinning or (if slept) sleeping.
+void
+lockacquired(struct lockclass *c, int contended, int slept, uint64 cycles)
+{
+  if(c == 0)
+    return;
+  pushcli();
+  c->cpu[cpuid()].nacquire++;
+  if(contended){
+    c->cpu[cpuid()].ncontend++;
+    c->cpu[cpuid()].spincycles += cycles;
+  }
+  if(slept)
+    c->cpu[cpuid()].nsleep++;
+  popcli();
+}
+
+void
+lockreleased(struct lockclass *c, uint64 hold)
+{
+  if(c == 0)
+    return;
+  pushcli();
+  if(hold > c->cpu[cpuid()].maxhold)
+    c->cpu[cpuid()].maxhold = hold;
+  popcli();
+}
+#endif
+
+#define NMCSNODE 8  // MCS locks one CPU can hold or wait for at once
+
+// Queue nodes for MCS locks, per CPU.  A CPU holds spin locks
+// with interrupts off and releases them on the same CPU, so
+// it can lend its nodes without any locking.
+static struct mcsnode mcsnodes[NCPU][NMCSNODE];
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+  lk->mcs = 0;
+  lk->next = 0;
+  lk->owner = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->class = lookupclass(name);
+#endif
+}
+
+// Like initlock, but make lk an MCS queue lock.  A ticket lock
+// makes every waiter spin on the same word, so each release
+// invalidates the line in every waiting CPU's cache; an MCS
+// waiter spins on its own node.  Worth it for locks that many
+// CPUs contend for; slightly slower uncontended.
+void
+initmcslock(struct spinlock *lk, char *name)
+{
+  initlock(lk, name);
+  lk->mcs = 1;
+}
+
+// Take a ticket and wait for it to be served.
+// Returns 1 if the lock was held when we arrived.
+static int
+ticketacquire(struct spinlock *lk)
+{
+  uint t;
+
+  t = xadd(&lk->next, 1);
+  if(lk->owner == t)
+    return 0;
+  while(lk->owner != t)
+    pause();
+  return 1;
+}
+
+static void
+ticketrelease(struct spinlock *lk)
+{
+  // Only the holder writes owner, so a plain increment is
+  // enough; the asm keeps it a single store.
+  asm volatile("incl %0" : "+m" (lk->owner) : : "memory");
+}
+
+// Join the queue and wait for our predecessor to hand over.
+// Returns 1 if the lock was held when we arrived.
+static int
+mcsacquire(struct spinlock *lk)
+{
+  struct mcsnode *n, *prev;
+
+  for(n = mcsnodes[cpuid()]; n < &mcsnodes[cpuid()][NMCSNODE]; n++)
+    if(!n->busy)
+      break;
+  if(n == &mcsnodes[cpuid()][NMCSNODE])
+    panic("mcsacquire: out of nodes");
+  n->busy = 1;
+  n->next = 0;
+  n->wait = 1;
+
+  prev = (struct mcsnode*)xchg((volatile uint*)&lk->tail, (uint)n);
+  if(prev != 0){
+    prev->next = n;
+    while(n->wait)
+      pause();
+  }
+  lk->node = n;
+  return prev != 0;
+}
+
+static void
+mcsrelease(struct spinlock *lk)
+{
+  struct mcsnode *n;
+
+  n = lk->node;
+  if(n->next == 0){
+    // No known successor: try to empty the queue.  If that
+    // fails, a waiter has swapped itself in as the tail and
+    // is about to link itself behind us.
+    if(cmpxchg((volatile uint*)&lk->tail, (uint)n, 0) == (uint)n)
+      goto done;
+    while(n->next == 0)
+      pause();
+  }
+  n->next->wait = 0;
+done:
+  n->busy = 0;
 }
 
 // Acquire the lock.
@@ -24,13 +204,32 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  int contended;
+#ifdef LOCKSTAT
+  uint64 t0;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+#ifdef LOCKSTAT
+  t0 = rdtsc();
+#endif
+  // The xadd and xchg are atomic, and the queues grant the
+  // lock in arrival order.
+  if(lk->mcs)
+    contended = mcsacquire(lk);
+  else
+    contended = ticketacquire(lk);
+#ifdef LOCKSTAT
+  if(contended && lk->class){
+    lk->class->cpu[cpuid()].ncontend++;
+    lk->class->cpu[cpuid()].spincycles += rdtsc() - t0;
+  }
+#else
+  (void)contended;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -38,8 +237,14 @@ acquire(struct spinlock *lk)
   __sync_synchronize();
 
   // Record info about lock acquisition for debugging.
+  lk->locked = 1;
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+#ifdef LOCKSTAT
+  if(lk->class)
+    lk->class->cpu[cpuid()].nacquire++;
+  lk->tacquire = rdtsc();
+#endif
 }
 
 // Release the lock.
@@ -49,8 +254,17 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  if(lk->class){
+    uint64 hold = rdtsc() - lk->tacquire;
+    if(hold > lk->class->cpu[cpuid()].maxhold)
+      lk->class->cpu[cpuid()].maxhold = hold;
+  }
+#endif
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
+  lk->locked = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -59,14 +273,138 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Pass the lock to the next waiter, if any.
+  if(lk->mcs)
+    mcsrelease(lk);
+  else
+    ticketrelease(lk);
+
+  popcli();
+}
+
+// Reader-writer spin locks.  state counts readers in units of
+// RWREADER above two flag bits.  Like spinlocks they are held
+// with interrupts off, and as with shared sleep locks a CPU must
+// not take one for reading twice.
+#define RWWRITER  1   // held by a writer
+#define RWWAITING 2   // a writer is waiting; readers stay out
+#define RWREADER  4
+
+void
+initrwlock(struct rwspinlock *lk, char *name)
+{
+  lk->name = name;
+  lk->state = 0;
+  lk->cpu = 0;
+}
+
+void
+acquireread(struct rwspinlock *lk)
+{
+  uint s;
+
+  pushcli();
+  for(;;){
+    s = lk->state;
+    if((s & (RWWRITER|RWWAITING)) == 0 &&
+       cmpxchg(&lk->state, s, s + RWREADER) == s)
+      break;
+    pause();
+  }
+  __sync_synchronize();
+}
 
+void
+releaseread(struct rwspinlock *lk)
+{
+  if(lk->state < RWREADER)
+    panic("releaseread");
+  __sync_synchronize();
+  xadd(&lk->state, -RWREADER);
   popcli();
 }
 
+void
+acquirewrite(struct rwspinlock *lk)
+{
+  uint s;
+
+  pushcli();
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+  for(;;){
+    s = lk->state;
+    if((s & ~RWWAITING) == 0){
+      // Free.  Taking it clears RWWAITING; any other waiting
+      // writer sets it again.
+      if(cmpxchg(&lk->state, s, RWWRITER) == s)
+        break;
+    } else if((s & RWWAITING) == 0)
+      cmpxchg(&lk->state, s, s | RWWAITING);
+    pause();
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwspinlock *lk)
+{
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+  lk->cpu = 0;
+  __sync_synchronize();
+  // Clear RWWRITER, leaving RWWAITING for the next writer.
+  xadd(&lk->state, -RWWRITER);
+  popcli();
+}
+
+// Check whether this cpu holds lk for writing.
+int
+holdingwrite(struct rwspinlock *lk)
+{
+  int r;
+
+  pushcli();
+  r = (lk->state & RWWRITER) && lk->cpu == mycpu();
+  popcli();
+  return r;
+}
+
+// Copy up to n lock statistics entries to dst, summed over CPUs,
+// and zero the counters if reset is set.  Returns the number of
+// entries, or -1 if the kernel was built without LOCKSTAT.
+int
+lockstat(struct lockstat *dst, int n, int reset)
+{
+#ifdef LOCKSTAT
+  struct lockclass *c;
+  int i, j, m;
+
+  m = nlockclass;
+  for(i = 0; i < m; i++){
+    c = &lockclass[i];
+    if(i < n){
+      memset(&dst[i], 0, sizeof(dst[i]));
+      safestrcpy(dst[i].name, c->name, sizeof(dst[i].name));
+      for(j = 0; j < ncpu; j++){
+        dst[i].nacquire += c->cpu[j].nacquire;
+        dst[i].ncontend += c->cpu[j].ncontend;
+        dst[i].nsleep += c->cpu[j].nsleep;
+        dst[i].spincycles += c->cpu[j].spincycles;
+        if(c->cpu[j].maxhold > dst[i].maxhold)
+          dst[i].maxhold = c->cpu[j].maxhold;
+      }
+    }
+    if(reset)
+      memset(c->cpu, 0, sizeof(c->cpu));
+  }
+  return m;
+#else
+  return -1;
+#endif
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -1,11 +1,38 @@
-// Mutual exclusion lock.
+// A waiter's place in an MCS lock's queue.  Each waiter spins
+// on its own node, so a release touches only the next waiter's
+// cache line.
+struct mcsnode {
+  struct mcsnode *volatile next;  // next waiter in the queue
+  volatile uint wait;             // cleared by our predecessor
+  uint busy;                      // in use by this CPU
+};
+
+// Mutual exclusion lock.  A ticket lock by default, which
+// grants the lock in arrival order; initmcslock makes it an
+// MCS queue lock instead, for locks contended by many CPUs.
 struct spinlock {
   uint locked;       // Is the lock held?
+  uint mcs;          // MCS queue lock rather than ticket lock?
+  volatile uint next;   // Ticket lock: next ticket to hand out
+  volatile uint owner;  // Ticket lock: ticket now being served
+  struct mcsnode *volatile tail;  // MCS: last waiter, or 0
+  struct mcsnode *node;           // MCS: the holder's node
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#ifdef LOCKSTAT
+  struct lockclass *class; // Statistics shared by locks with this name.
+  uint64 tacquire;   // When the holder acquired the lock.
+#endif
 };
 
+// Reader-writer spin lock: any number of readers, or one
+// writer.  A waiting writer holds off new readers.
+struct rwspinlock {
+  volatile uint state;  // RWWRITER | RWWAITING | readers*RWREADER
+  char *name;           // Name of lock.
+  struct cpu *cpu;      // The cpu holding the lock for writing.
+};
@@ -3,9 +3,13 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "x86.h"
 #include "syscall.h"
+#include "trace.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -19,7 +23,7 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(addr >= curproc->mm->sz || addr+4 > curproc->mm->sz)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,10 +38,10 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if(addr >= curproc->mm->sz)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
+  ep = (char*)curproc->mm->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -63,7 +67,7 @@ argptr(int n, char **pp, int size)
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || (uint)i >= curproc->mm->sz || (uint)i+size > curproc->mm->sz)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -107,6 +111,21 @@ extern int sys_kmalloc(void); //
 extern int sys_kmfree(void);  //
 extern int sys_mmap(void);    //
 extern int sys_munmap(void);  //
+extern int sys_tracectl(void);
+extern int sys_traceread(void);
+extern int sys_lockstat(void);
+extern int sys_profctl(void);
+extern int sys_profread(void);
+extern int sys_lseek(void);
+extern int sys_nice(void);
+extern int sys_getpinfo(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_bstat(void);
+extern int sys_bcachectl(void);
+extern int sys_dstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +153,21 @@ static int (*syscalls[])(void) = {
 [SYS_kmfree]  sys_kmfree,
 [SYS_mmap]    sys_mmap,
 [SYS_munmap]  sys_munmap,
+[SYS_tracectl]  sys_tracectl,
+[SYS_traceread] sys_traceread,
+[SYS_lockstat]  sys_lockstat,
+[SYS_profctl]   sys_profctl,
+[SYS_profread]  sys_profread,
+[SYS_lseek]     sys_lseek,
+[SYS_nice]      sys_nice,
+[SYS_getpinfo]  sys_getpinfo,
+[SYS_clone]     sys_clone,
+[SYS_join]      sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_bstat]     sys_bstat,
+[SYS_bcachectl] sys_bcachectl,
+[SYS_dstat]     sys_dstat,
 };
 
 void
@@ -144,7 +178,9 @@ syscall(void)
 
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    trace(TR_SYSENTER, num);
     curproc->tf->eax = syscalls[num]();
+    trace(TR_SYSEXIT, curproc->tf->eax);
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
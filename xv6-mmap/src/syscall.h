@@ -24,3 +24,18 @@
 #define SYS_kmfree  23  
 #define SYS_mmap    24  
 #define SYS_munmap  25  
+#define SYS_tracectl  26
+#define SYS_traceread 27
+#define SYS_lockstat  28
+#define SYS_profctl   29
+#define SYS_profread  30
+#define SYS_lseek     31
+#define SYS_nice      32
+#define SYS_getpinfo  33
+#define SYS_clone     34
+#define SYS_join      35
+#define SYS_futex_wait 36
+#define SYS_futex_wake 37
+#define SYS_bstat     38
+#define SYS_bcachectl 39
+#define SYS_dstat     40
@@ -9,12 +9,13 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "bstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=myproc()->fdt->ofile[fd]) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -41,14 +42,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct fdtable *fdt = myproc()->fdt;
 
+  acquire(&fdt->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(fdt->ofile[fd] == 0){
+      fdt->ofile[fd] = f;
+      release(&fdt->lock);
       return fd;
     }
   }
+  release(&fdt->lock);
   return -1;
 }
 
@@ -95,10 +99,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct fdtable *fdt = myproc()->fdt;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
+    return -1;
+  // Another thread may be closing fd too.
+  acquire(&fdt->lock);
+  if((f = fdt->ofile[fd]) == 0){
+    release(&fdt->lock);
     return -1;
-  myproc()->ofile[fd] = 0;
+  }
+  fdt->ofile[fd] = 0;
+  release(&fdt->lock);
   fileclose(f);
   return 0;
 }
@@ -114,6 +126,17 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+int
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -328,6 +351,7 @@ sys_open(void)
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  f->raoff = f->rablock = f->rawin = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
   return fd;
@@ -434,7 +458,7 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      myproc()->fdt->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -443,3 +467,35 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_bstat(void)
+{
+  struct bstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  bstat(st);
+  return 0;
+}
+
+int
+sys_bcachectl(void)
+{
+  int policy, maxbuf;
+
+  if(argint(0, &policy) < 0 || argint(1, &maxbuf) < 0)
+    return -1;
+  return bcachectl(policy, maxbuf);
+}
+
+int
+sys_dstat(void)
+{
+  struct dstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  idestat(st);
+  return 0;
+}
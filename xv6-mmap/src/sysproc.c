@@ -5,7 +5,15 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
+#include "trace.h"
+#include "lockstat.h"
+#include "prof.h"
+#include "timer.h"
+#include "pinfo.h"
 
 int
 sys_kmalloc(void)
@@ -40,6 +48,8 @@ sys_mmap(void)
   int flags;
   int fd;
   int offset;
+  int r;
+  struct mm *mm = myproc()->mm;
 
   if(argint(0, &addr) < 0)
   {
@@ -66,8 +76,11 @@ sys_mmap(void)
     return -1;
   }
 
-  return (int)mmap((void*)addr, (uint)length, (uint)prot,
-                    (uint)flags, (uint)fd, (uint)offset);
+  acquiresleep(&mm->lock);
+  r = (int)mmap((void*)addr, (uint)length, (uint)prot,
+                (uint)flags, (uint)fd, (uint)offset);
+  releasesleep(&mm->lock);
+  return r;
 }
 
 int
@@ -75,6 +88,8 @@ sys_munmap(void)
 {
   int addr;
   int length;
+  int r;
+  struct mm *mm = myproc()->mm;
 
   if(argint(0, &addr) < 0)
   {
@@ -85,7 +100,92 @@ sys_munmap(void)
     return -1;
   }
 
-  return munmap((void*)addr, (uint)length);
+  acquiresleep(&mm->lock);
+  r = munmap((void*)addr, (uint)length);
+  releasesleep(&mm->lock);
+  return r;
+}
+
+int
+sys_tracectl(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return tracectl(on);
+}
+
+int
+sys_traceread(void)
+{
+  struct traceent *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(argptr(0, (char**)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return traceread(buf, n);
+}
+
+int
+sys_lockstat(void)
+{
+  struct lockstat *buf;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || n < 0 || argint(2, &reset) < 0)
+    return -1;
+  if(argptr(0, (char**)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return lockstat(buf, n, reset);
+}
+
+int
+sys_profctl(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return profctl(on);
+}
+
+int
+sys_profread(void)
+{
+  struct profsample *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(argptr(0, (char**)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return profread(buf, n);
+}
+
+int
+sys_nice(void)
+{
+  int pid, level;
+
+  if(argint(0, &pid) < 0 || argint(1, &level) < 0)
+    return -1;
+  return nice(pid, level);
+}
+
+int
+sys_getpinfo(void)
+{
+  struct pinfo *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(argptr(0, (char**)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return getpinfo(buf, n);
 }
 
 int
@@ -107,6 +207,46 @@ sys_wait(void)
   return wait();
 }
 
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone((void(*)(void*))fn, (void*)arg, (void*)stack);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
 int
 sys_kill(void)
 {
@@ -128,12 +268,15 @@ sys_sbrk(void)
 {
   int addr;
   int n;
+  struct mm *mm = myproc()->mm;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  acquiresleep(&mm->lock);
+  addr = mm->sz;
   if(growproc(n) < 0)
-    return -1;
+    addr = -1;
+  releasesleep(&mm->lock);
   return addr;
 }
 
@@ -142,18 +285,27 @@ sys_sleep(void)
 {
   int n;
   uint ticks0;
+  struct timer t;
 
   if(argint(0, &n) < 0)
     return -1;
   acquire(&tickslock);
   ticks0 = ticks;
+  // The timer wakes only this process, when it is due.
+  t.expires = ticks0 + n;
+  t.fn = wakeup;
+  t.arg = &t;
+  t.list = 0;
+  timeradd(&t);
   while(ticks - ticks0 < n){
     if(myproc()->killed){
+      timerdel(&t);
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(&t, &tickslock);
   }
+  timerdel(&t);
   release(&tickslock);
   return 0;
 }
@@ -0,0 +1,105 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "mmu.h"
+
+#define NPAGE 8
+#define NROUND 10
+
+/*Threads: one thread keeps read()ing into, or write()ing from, a region while another munmaps it; the kernel must kill the thread or fail the call, not panic.*/
+char *region;
+int fd;
+volatile int started;
+
+void
+noop(void *arg)
+{
+}
+
+// Read the file into region until a read fails, or the kernel
+// kills this thread for touching region after it was unmapped.
+void
+reader(void *arg)
+{
+  for(;;){
+    if(lseek(fd, 0, SEEK_SET) < 0 || read(fd, region, NPAGE*PGSIZE) < 0)
+      return;
+    started = 1;
+  }
+}
+
+// Likewise, writing the file from region.
+void
+writer(void *arg)
+{
+  for(;;){
+    if(lseek(fd, 0, SEEK_SET) < 0 || write(fd, region, NPAGE*PGSIZE) < 0)
+      return;
+    started = 1;
+  }
+}
+
+// Run fn on a fresh region, and unmap the region under it.
+int
+race(void (*fn)(void*))
+{
+  region = mmap(0, NPAGE*PGSIZE, 0/*prot*/, 0/*flags*/, -1/*fd*/, 0/*offset*/);
+  if (region == (char*)-1)
+    return -1;
+  started = 0;
+  if(thread_create(fn, 0) < 0)
+    return -1;
+  while(!started)
+    ;
+  if (munmap(region, NPAGE*PGSIZE) < 0)
+    return -1;
+  if(thread_join() < 0)
+    return -1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static char buf[NPAGE*PGSIZE];
+  int r;
+
+  // Get the threads' stacks from sbrk now, so that they are
+  // never at the top of the address space, which munmap shrinks.
+  if(thread_create(noop, 0) < 0 || thread_join() < 0){
+    printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+    exit();
+  }
+
+  if((fd = open("test_10.dat", O_CREATE|O_RDWR)) < 0 ||
+     write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(1, "XV6_TEST_OUTPUT : cannot create test_10.dat\n");
+    exit();
+  }
+
+  for(r = 0; r < NROUND; r++){
+    if(race(reader) < 0){
+      printf(1, "XV6_TEST_OUTPUT : read race failed\n");
+      exit();
+    }
+  }
+  printf(1, "XV6_TEST_OUTPUT : read into unmapped region good\n");
+
+  for(r = 0; r < NROUND; r++){
+    if(race(writer) < 0){
+      printf(1, "XV6_TEST_OUTPUT : write race failed\n");
+      exit();
+    }
+  }
+  printf(1, "XV6_TEST_OUTPUT : write from unmapped region good\n");
+
+  close(fd);
+  unlink("test_10.dat");
+  exit();
+}
@@ -0,0 +1,125 @@
+// Kernel timers, kept in a hierarchical timing wheel.
+//
+// A timer runs its function once, from the timer interrupt
+// on CPU 0, at the tick it expires.  Level 0 of the wheel has
+// one slot per tick for the next NSLOT ticks; level 1 has one
+// slot per NSLOT ticks for the next NSLOT*NSLOT ticks; later
+// timers wait on an overflow list.  Every NSLOT ticks one
+// level 1 slot is spread over level 0, and every NSLOT*NSLOT
+// ticks the overflow list is moved into the wheel, so each
+// tick costs O(1) plus the timers that actually expire.
+//
+// tickslock protects the wheel and all timers on it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define SLOTBITS 6
+#define NSLOT    (1 << SLOTBITS)
+#define SLOTMASK (NSLOT - 1)
+
+static struct timer *level0[NSLOT];
+static struct timer *level1[NSLOT];
+static struct timer *overflow;
+
+static void
+unlink(struct timer *t)
+{
+  if(t->prev)
+    t->prev->next = t->next;
+  else
+    *t->list = t->next;
+  if(t->next)
+    t->next->prev = t->prev;
+  t->list = 0;
+}
+
+// Put t on the slot for its expiry time, which is at most
+// NSLOT*NSLOT ticks away, or on the overflow list.
+static void
+place(struct timer *t)
+{
+  struct timer **list;
+  uint delta;
+
+  delta = t->expires - ticks;
+  if(delta < NSLOT)
+    list = &level0[t->expires & SLOTMASK];
+  else if(delta < NSLOT*NSLOT)
+    list = &level1[(t->expires >> SLOTBITS) & SLOTMASK];
+  else
+    list = &overflow;
+  t->list = list;
+  t->prev = 0;
+  t->next = *list;
+  if(t->next)
+    t->next->prev = t;
+  *list = t;
+}
+
+// Re-place every timer on *list.
+static void
+cascade(struct timer **list)
+{
+  struct timer *t, *next;
+
+  t = *list;
+  *list = 0;
+  for(; t != 0; t = next){
+    next = t->next;
+    place(t);
+  }
+}
+
+// Arrange for t->fn(t->arg) to run when ticks reaches
+// t->expires, or now if it already has.  Caller holds
+// tickslock, and t must not be pending already.
+void
+timeradd(struct timer *t)
+{
+  if(!holding(&tickslock))
+    panic("timeradd");
+  if(t->list)
+    panic("timeradd pending");
+  if((int)(t->expires - ticks) <= 0){
+    t->fn(t->arg);
+    return;
+  }
+  place(t);
+}
+
+// Cancel t if it has not run yet.  Caller holds tickslock.
+void
+timerdel(struct timer *t)
+{
+  if(!holding(&tickslock))
+    panic("timerdel");
+  if(t->list)
+    unlink(t);
+}
+
+// Run the timers that expire at the current tick.  Called
+// by the timer interrupt after advancing ticks, holding
+// tickslock.
+void
+timertick(void)
+{
+  struct timer *t;
+  struct timer **list;
+
+  if((ticks & (NSLOT*NSLOT - 1)) == 0)
+    cascade(&overflow);
+  if((ticks & SLOTMASK) == 0)
+    cascade(&level1[(ticks >> SLOTBITS) & SLOTMASK]);
+
+  // Everything on this slot expires now; a function may
+  // add or delete timers, so take them off one at a time.
+  list = &level0[ticks & SLOTMASK];
+  while((t = *list) != 0){
+    unlink(t);
+    t->fn(t->arg);
+  }
+}
@@ -0,0 +1,10 @@
+// One-shot kernel timer (see timer.c).
+struct timer {
+  uint expires;            // value of ticks at which fn runs
+  void (*fn)(void*);       // called with tickslock held; must not sleep
+  void *arg;               // passed to fn
+
+  struct timer **list;     // wheel slot the timer is on, or 0
+  struct timer *next;
+  struct timer *prev;
+};
@@ -0,0 +1,152 @@
+// Per-CPU kernel event trace.
+//
+// Each CPU appends fixed-size records to its own ring with
+// interrupts disabled, so recording an event takes no lock,
+// never waits, and never touches the console.  A reader
+// (traceread) copies records out behind the writer.  If the
+// reader falls more than NTRACE records behind, the oldest
+// records are overwritten and reported as a TR_LOST record.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+
+#define NTRACE 512  // records per CPU; must be a power of 2
+
+struct tracering {
+  volatile uint head;  // next slot the owning CPU writes
+  uint tail;           // next slot the reader reads
+  struct traceent ent[NTRACE];
+};
+
+static struct tracering rings[NCPU];
+static struct spinlock readlock;  // serializes readers, never writers
+int tracing;                      // record events while non-zero
+
+void
+traceinit(void)
+{
+  initlock(&readlock, "trace");
+}
+
+// Record an event on this CPU's ring.
+// Safe to call from any context, including interrupt handlers.
+void
+trace(int event, uint arg)
+{
+  struct tracering *r;
+  struct traceent *e;
+  struct proc *p;
+
+  if(!tracing)
+    return;
+
+  pushcli();
+  p = mycpu()->proc;
+  // Keep switches to an untraced process, so the trace still
+  // shows the CPU leaving the previous one.
+  if(p && p->notrace && event != TR_SWITCH){
+    popcli();
+    return;
+  }
+  r = &rings[cpuid()];
+  e = &r->ent[r->head & (NTRACE-1)];
+  e->tsc = rdtsc();
+  e->event = event;
+  e->cpu = cpuid();
+  e->pid = p ? p->pid : 0;
+  e->arg = arg;
+  // Publish the record before advancing head.
+  __sync_synchronize();
+  r->head++;
+  popcli();
+}
+
+// Turn tracing on (on == 1) or off (on == 0) and return the
+// previous setting; on < 0 just returns the current setting.
+// Turning tracing on discards any records not yet read.
+// on == TC_NOSELF leaves tracing alone and stops recording the
+// calling process's events, for the rest of its life.
+int
+tracectl(int on)
+{
+  int i, old;
+
+  acquire(&readlock);
+  old = tracing;
+  if(on == TC_NOSELF)
+    myproc()->notrace = 1;
+  else if(on > 0 && !tracing){
+    for(i = 0; i < ncpu; i++)
+      rings[i].tail = rings[i].head;
+    tracing = 1;
+  } else if(on == 0)
+    tracing = 0;
+  release(&readlock);
+  return old;
+}
+
+// Copy up to n records from the rings into dst.
+// Returns the number of records copied.
+int
+traceread(struct traceent *dst, int n)
+{
+  struct tracering *r;
+  uint head, start, i, lost, bad;
+  int c, m, k;
+
+  m = 0;
+  acquire(&readlock);
+  for(c = 0; c < ncpu; c++){
+    // Keep one slot spare for a TR_LOST record.
+    if(n - m < 2)
+      break;
+    r = &rings[c];
+    head = r->head;
+    __sync_synchronize();
+    start = r->tail;
+    lost = 0;
+    if(head - start > NTRACE){
+      lost = head - start - NTRACE;
+      start = head - NTRACE;
+    }
+    k = m;
+    for(i = start; i != head && k < n-1; i++)
+      dst[k++] = r->ent[i & (NTRACE-1)];
+    r->tail = i;
+
+    // The writer may have lapped us during the copy; drop any
+    // record whose slot was being reused while we read it.
+    __sync_synchronize();
+    head = r->head;
+    bad = 0;
+    if(head - start >= NTRACE)
+      bad = head - start - NTRACE + 1;
+    if(bad > k - m)
+      bad = k - m;
+    if(bad){
+      memmove(dst+m, dst+m+bad, (k-m-bad) * sizeof(*dst));
+      k -= bad;
+      lost += bad;
+    }
+
+    if(lost){
+      memmove(dst+m+1, dst+m, (k-m) * sizeof(*dst));
+      dst[m].tsc = k > m ? dst[m+1].tsc : rdtsc();
+      dst[m].event = TR_LOST;
+      dst[m].cpu = c;
+      dst[m].pid = 0;
+      dst[m].arg = lost;
+      k++;
+    }
+    m = k;
+  }
+  release(&readlock);
+  return m;
+}
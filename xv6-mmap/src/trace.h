@@ -0,0 +1,22 @@
+// Kernel trace events, recorded by trace() in trace.c
+// and read out by the traceread system call.
+
+#define TR_SYSENTER  1   // system call entry, arg = call number
+#define TR_SYSEXIT   2   // system call exit, arg = return value
+#define TR_FAULT     3   // processor exception, arg = trap number
+#define TR_SWITCH    4   // scheduler switch, arg = pid switched to
+#define TR_BMISS     5   // buffer cache miss, arg = block number
+#define TR_LOST      6   // reader fell behind, arg = records lost
+#define TR_STEAL     7   // idle CPU stole a process, arg = its pid
+
+// tracectl argument: stop recording the calling process's own
+// events, so a process reading the trace does not feed it.
+#define TC_NOSELF    2
+
+struct traceent {
+  uint64 tsc;      // time stamp counter when recorded
+  ushort event;    // TR_*
+  ushort cpu;      // CPU that recorded the event
+  int pid;         // process running on that CPU, 0 if none
+  uint arg;        // event-specific argument
+};
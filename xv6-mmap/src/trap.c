@@ -3,10 +3,11 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
+#include "trace.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -46,12 +47,16 @@ trap(struct trapframe *tf)
     return;
   }
 
+  if(tf->trapno < T_IRQ0)
+    trace(TR_FAULT, tf->trapno);
+
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
+    profsample(tf);
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
+      timertick();
       release(&tickslock);
     }
     lapiceoi();
@@ -71,6 +76,10 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    tlbflushintr();
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -78,6 +87,19 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // A system call touching user memory that a sibling thread
+    // has just unmapped (error code bit 0: page not present).
+    if(myproc() && (tf->cs&3) == 0 && rcr2() < KERNBASE &&
+       myproc()->tf->trapno == T_SYSCALL && (tf->err & 1) == 0 &&
+       sinkfault(myproc(), rcr2()) == 0){
+      cprintf("pid %d %s: kernel fault on unmapped user address "
+              "0x%x--kill proc\n", myproc()->pid, myproc()->name, rcr2());
+      myproc()->killed = 1;
+      break;
+    }
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -100,10 +122,11 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU when its time slice is used up
+  // (see timeslice in proc.c).
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && timeslice())
     yield();
 
   // Check if the process has been killed since we yielded
@@ -104,3 +104,129 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// 64-bit unsigned division by shift and subtract;
+// user programs are not linked with libgcc.
+uint64
+udiv64(uint64 n, uint64 d)
+{
+  uint64 q, bit;
+
+  if(d == 0)
+    return 0;
+  q = 0;
+  bit = 1;
+  while(d < n && !(d >> 63)){
+    d <<= 1;
+    bit <<= 1;
+  }
+  for(; bit; d >>= 1, bit >>= 1){
+    if(n >= d){
+      n -= d;
+      q |= bit;
+    }
+  }
+  return q;
+}
+
+//
+// Threads.  A thread runs on a one-page stack from malloc;
+// the pointer to free sits just below the stack page.
+//
+
+#define TSTACK 4096
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+// clone() starts here; the tstart is at the bottom of
+// the thread's stack.
+static void
+tmain(void *a)
+{
+  struct tstart *ts = a;
+
+  ts->fn(ts->arg);
+  exit();
+}
+
+// Run fn(arg) in a new thread sharing this process's memory
+// and open files.  Returns the thread's pid, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *mem, *stack;
+  struct tstart *ts;
+  int pid;
+
+  if((mem = malloc(2*TSTACK)) == 0)
+    return -1;
+  stack = (char*)(((uint)mem + sizeof(char*) + TSTACK-1) & ~(TSTACK-1));
+  ((char**)stack)[-1] = mem;
+  ts = (struct tstart*)stack;
+  ts->fn = fn;
+  ts->arg = arg;
+  if((pid = clone(tmain, ts, stack)) < 0)
+    free(mem);
+  return pid;
+}
+
+// Wait for a thread created by this one to exit and free
+// its stack.  Returns its pid, or -1 if there are none.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(((char**)stack)[-1]);
+  return pid;
+}
+
+void
+lock_init(lock_t *lk)
+{
+  lk->locked = 0;
+}
+
+void
+lock_acquire(lock_t *lk)
+{
+  while(xchg(&lk->locked, 1) != 0)
+    ;
+}
+
+void
+lock_release(lock_t *lk)
+{
+  xchg(&lk->locked, 0);
+}
+
+// A mutex is 0 when free, 1 when held, and 2 when held with
+// (possibly) some thread waiting in futex_wait.  Taking a free
+// mutex and releasing an uncontended one are single atomic
+// instructions; only contention enters the kernel.
+void
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+  if(xchg((volatile uint*)&m->state, 1) == 0)
+    return;
+  while(xchg((volatile uint*)&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  if(xchg((volatile uint*)&m->state, 0) == 2)
+    futex_wake(&m->state, 1);
+}
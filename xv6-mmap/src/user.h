@@ -1,5 +1,21 @@
 struct stat;
 struct rtcdate;
+struct traceent;
+struct lockstat;
+struct profsample;
+struct pinfo;
+struct bstat;
+struct dstat;
+
+// A spin lock for threads (see ulib.c).
+typedef struct {
+  volatile uint locked;
+} lock_t;
+
+// A sleeping lock for threads, built on futexes (see ulib.c).
+typedef struct {
+  volatile int state;
+} mutex_t;
 
 // system calls
 int fork(void);
@@ -27,6 +43,21 @@ void* kmalloc(uint);
 void kmfree(void*);
 void* mmap(void *addr, uint length, uint prot, uint flags, uint fd, uint offset);
 int munmap(void *addr, uint length);
+int tracectl(int);
+int traceread(struct traceent*, int);
+int lockstat(struct lockstat*, int, int);
+int profctl(int);
+int profread(struct profsample*, int);
+int lseek(int, int, int);
+int nice(int, int);
+int getpinfo(struct pinfo*, int);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futex_wait(volatile int*, int);
+int futex_wake(volatile int*, int);
+int bstat(struct bstat*);
+int bcachectl(int, int);
+int dstat(struct dstat*);
 void* kmalloc(uint);
 void kmfree(void*);
 
@@ -43,3 +74,12 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint64 udiv64(uint64, uint64);
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
+void lock_init(lock_t*);
+void lock_acquire(lock_t*);
+void lock_release(lock_t*);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+void mutex_unlock(mutex_t*);
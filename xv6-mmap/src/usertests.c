@@ -1374,8 +1374,7 @@ iref(void)
 }
 
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// the forktest binary also does this, with a smaller process.
 void
 forktest(void)
 {
@@ -1383,7 +1382,7 @@ forktest(void)
 
   printf(1, "fork test\n");
 
-  for(n=0; n<1000; n++){
+  for(n=0; n<100000; n++){
     pid = fork();
     if(pid < 0)
       break;
@@ -1391,8 +1390,8 @@ forktest(void)
       exit();
   }
 
-  if(n == 1000){
-    printf(1, "fork claimed to work 1000 times!\n");
+  if(n == 100000){
+    printf(1, "fork claimed to work 100000 times!\n");
     exit();
   }
 
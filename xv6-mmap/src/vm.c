@@ -4,8 +4,14 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "mm.h"
 #include "elf.h"
+#include "traps.h"
+
+#define NSHRINK 64  // frames shrinkuvm frees per TLB shootdown
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -68,7 +74,7 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   for(;;){
     if((pte = walkpgdir(pgdir, a, 1)) == 0)
       return -1;
-    if(*pte & PTE_P)
+    if((*pte & (PTE_P|PTE_SINK)) == PTE_P)
       panic("remap");
     *pte = pa | perm | PTE_P;
     if(a == last)
@@ -160,7 +166,7 @@ switchuvm(struct proc *p)
     panic("switchuvm: no process");
   if(p->kstack == 0)
     panic("switchuvm: no kstack");
-  if(p->pgdir == 0)
+  if(p->mm == 0 || p->mm->pgdir == 0)
     panic("switchuvm: no pgdir");
 
   pushcli();
@@ -173,10 +179,64 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  lcr3(V2P(p->mm->pgdir));  // switch to process's address space
   popcli();
 }
 
+// TLB shootdown.  When an address space loses mappings, other
+// CPUs running its threads may still have them in their TLBs.
+// tlbshootdown interrupts each of those CPUs and waits until it
+// has reloaded %cr3.  A CPU's tlbreq counts the flushes asked
+// of it; the interrupt handler reads tlbreq before flushing and
+// stores it in tlbdone afterwards, so a requester is done once
+// tlbdone reaches the value it set.  Interrupts stay enabled
+// while waiting, so two CPUs shooting at each other still
+// service each other's requests.
+
+// Make other CPUs forget mm's old mappings.  The caller has
+// already flushed its own TLB (switchuvm), and holds no
+// spinlocks.
+void
+tlbshootdown(struct mm *mm)
+{
+  struct cpu *c, *me;
+  struct proc *p;
+  uint want[NCPU], sent;
+
+  sent = 0;
+  pushcli();
+  me = mycpu();
+  // Order the page table updates before reading c->proc;
+  // a CPU that switches to mm later loads a fresh %cr3.
+  __sync_synchronize();
+  for(c = cpus; c < cpus+ncpu; c++){
+    p = c->proc;
+    if(c == me || p == 0 || p->mm != mm)
+      continue;
+    want[c-cpus] = __sync_add_and_fetch(&c->tlbreq, 1);
+    sent |= 1 << (c-cpus);
+    lapicipi(c->apicid, T_TLBFLUSH);
+  }
+  popcli();
+
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(sent & (1 << (c-cpus)))
+      while((int)(c->tlbdone - want[c-cpus]) < 0)
+        ;
+}
+
+// Handle a T_TLBFLUSH interrupt.
+void
+tlbflushintr(void)
+{
+  struct cpu *c = mycpu();
+  uint req;
+
+  req = c->tlbreq;
+  lcr3(rcr3());
+  c->tlbdone = req;
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -266,6 +326,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if((*pte & PTE_SINK) != 0)
+      *pte = 0;
     else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
@@ -278,6 +340,83 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Shrink the address space of p, which may be shared with other
+// threads, from oldsz to newsz.  Those threads may still reach the
+// old pages through stale TLB entries, so the frames cannot be freed
+// while the PTEs are cleared, as deallocuvm does.  Instead the PTEs
+// are cleared NSHRINK frames at a time, and each batch is freed once
+// every CPU running p->mm has flushed its TLB.  Caller holds
+// p->mm->lock.  Returns newsz.
+int
+shrinkuvm(struct proc *p, uint oldsz, uint newsz)
+{
+  char *frame[NSHRINK];
+  pde_t *pgdir;
+  pte_t *pte;
+  uint a;
+  int i, n;
+
+  if(newsz >= oldsz)
+    return oldsz;
+
+  pgdir = p->mm->pgdir;
+  a = PGROUNDUP(newsz);
+  while(a < oldsz){
+    n = 0;
+    for(; a < oldsz && n < NSHRINK; a += PGSIZE){
+      pte = walkpgdir(pgdir, (char*)a, 0);
+      if(!pte)
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      else if((*pte & PTE_P) != 0){
+        if((*pte & PTE_SINK) == 0){
+          if(PTE_ADDR(*pte) == 0)
+            panic("shrinkuvm");
+          frame[n++] = P2V(PTE_ADDR(*pte));
+        }
+        *pte = 0;
+      }
+    }
+    switchuvm(p);
+    tlbshootdown(p->mm);
+    for(i = 0; i < n; i++)
+      kfree(frame[i]);
+  }
+  return newsz;
+}
+
+// A system call checked a user address against mm->sz, and
+// another thread unmapped it before the call touched it.  Map
+// p->mm's sink page at va, without PTE_U, so that the kernel's
+// access completes and the call can return; trap kills p.
+// The sink stays mapped until the address is mapped again
+// or unmapped.  Called from trap with interrupts off.
+// Returns 0, or -1 if va was not unmapped that way.
+int
+sinkfault(struct proc *p, uint va)
+{
+  struct mm *mm;
+  pte_t *pte;
+  char *sink;
+
+  mm = p->mm;
+  if((pte = walkpgdir(mm->pgdir, (char*)va, 0)) == 0)
+    return -1;
+  // Another thread may have mapped va since the fault.
+  if(*pte & PTE_P)
+    return 0;
+  if(*pte != 0)
+    return -1;
+  if(mm->sink == 0){
+    if((sink = kalloc()) == 0)
+      return -1;
+    memset(sink, 0, PGSIZE);
+    if(cmpxchg((volatile uint*)&mm->sink, 0, (uint)sink) != 0)
+      kfree(sink);
+  }
+  cmpxchg(pte, 0, V2P(mm->sink) | PTE_P | PTE_W | PTE_SINK);
+  return 0;
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -295,8 +434,6 @@ freevm(pde_t *pgdir)
     }
   }
   kfree((char*)pgdir);
-
-  free_mmap_ll();
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
@@ -354,7 +491,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
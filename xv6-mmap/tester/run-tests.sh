@@ -125,15 +125,39 @@ run_and_check () {
     fi
 }
 
+# run_bench testdir testnumber verbose failmode
+#   like run_and_check, but only runs the test and shows its output;
+#   benchmark results vary from run to run, so there is nothing to diff
+run_bench () {
+    local testdir=$1
+    local testnum=$2
+    local verbose=$3
+    local failmode=$4
+
+    if [[ ! -f $testdir/$testnum.run ]]; then
+	if (( $failmode == 1 )); then
+	    echo "benchmark $testnum does not exist" >&2; exit 1
+	fi
+	exit 0
+    fi
+    echo -n -e "\e[33mrunning benchmark $testnum: \e[0m"
+    cat $testdir/$testnum.desc
+    run_test $testdir $testnum $verbose
+    cat tests-out/$testnum.out
+    echo "results saved in tests-out/$testnum.out"
+    echo ""
+}
+
 # usage: call when args not parsed, or when help needed
 usage () {
-    echo "usage: run-tests.sh [-h] [-v] [-t test] [-c] [-s] [-d testdir]"
+    echo "usage: run-tests.sh [-h] [-v] [-t test] [-c] [-s] [-d testdir] [-b]"
     echo "  -h                help message"
     echo "  -v                verbose"
     echo "  -t n              run only test n"
     echo "  -c                continue even after failure"
     echo "  -s                skip pre-test initialization"
     echo "  -d testdir        run tests from testdir"
+    echo "  -b                run benchmarks from bench/ and capture their output"
     return 0
 }
 
@@ -145,8 +169,9 @@ testdir="tests"
 contrunning=0
 skippre=0
 specific=""
+bench=0
 
-args=`getopt hvsct:d: $*`
+args=`getopt hvsct:d:b $*`
 if [[ $? != 0 ]]; then
     usage; exit 1
 fi
@@ -180,6 +205,12 @@ for i; do
         testdir=$2
 	shift
         shift;;
+    -b)
+        bench=1
+	if [[ $testdir == "tests" ]]; then
+	    testdir="bench"
+	fi
+        shift;;
     --)
         shift; break;;
     esac
@@ -205,6 +236,10 @@ fi
 
 # run just one test
 if [[ $specific != "" ]]; then
+    if (( $bench == 1 )); then
+	run_bench $testdir $specific $verbose 1
+	exit 0
+    fi
     run_and_check $testdir $specific $contrunning $verbose 1
     exit 0
 fi
@@ -212,7 +247,11 @@ fi
 # run all tests
 (( testnum = 1 ))
 while true; do
-    run_and_check $testdir $testnum $contrunning $verbose 0
+    if (( $bench == 1 )); then
+	run_bench $testdir $testnum $verbose 0
+    else
+	run_and_check $testdir $testnum $contrunning $verbose 0
+    fi
     (( testnum = $testnum + 1 ))
 done
 
@@ -0,0 +1,72 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "mmu.h"
+
+#define NTHREAD 4
+#define NITER 1000
+
+/*Threads: clone/join share the address space, and an anonymous mmap made by one thread is visible to the others.*/
+lock_t lock;
+int counter;
+char *shared;
+
+void
+worker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    lock_acquire(&lock);
+    counter++;
+    lock_release(&lock);
+  }
+  shared[(int)arg] = 'a' + (int)arg;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid[NTHREAD];
+
+  shared = mmap(0, PGSIZE, 0/*prot*/, 0/*flags*/, -1/*fd*/, 0/*offset*/);
+  if (shared == (char*)-1)
+  {
+    printf(1, "XV6_TEST_OUTPUT : mmap failed\n");
+    exit();
+  }
+  memset(shared, 0, PGSIZE);
+  lock_init(&lock);
+
+  for(i = 0; i < NTHREAD; i++){
+    if((pid[i] = thread_create(worker, (void*)i)) < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join() < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_join failed\n");
+      exit();
+    }
+  }
+  printf(1, "XV6_TEST_OUTPUT : counter = %d\n", counter);
+  printf(1, "XV6_TEST_OUTPUT : shared = %s\n", shared);
+
+  if (thread_join() >= 0 || wait() >= 0)
+    printf(1, "XV6_TEST_OUTPUT : extra child\n");
+
+  if (munmap(shared, PGSIZE) < 0)
+  {
+    printf(1, "XV6_TEST_OUTPUT : munmap failed\n");
+    exit();
+  }
+  printf(1, "XV6_TEST_OUTPUT : munmap good\n");
+  exit();
+}
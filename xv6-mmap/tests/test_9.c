@@ -0,0 +1,132 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "traps.h"
+#include "memlayout.h"
+#include "mmu.h"
+
+#define NPAGE 8
+#define NROUND 10
+
+/*Threads: one thread keeps writing to a region while another munmaps or sbrk-shrinks it; the writer must fault, and the freed pages must not be written after they are reused.*/
+volatile char *region;
+volatile int started;
+
+void
+noop(void *arg)
+{
+}
+
+void
+writer(void *arg)
+{
+  int i;
+
+  for(;;){
+    for(i = 0; i < NPAGE; i++)
+      region[i*PGSIZE] = 'w';
+    started = 1;
+  }
+}
+
+// Start a writer on region and wait until it is running.
+int
+startwriter(void)
+{
+  started = 0;
+  if(thread_create(writer, 0) < 0)
+    return -1;
+  while(!started)
+    ;
+  return 0;
+}
+
+// Check that freshly mapped memory is zero, which it would not be
+// if a writer had scribbled on one of its frames after it was freed.
+int
+clean(void)
+{
+  char *p;
+  int i, ok;
+
+  p = mmap(0, NPAGE*PGSIZE, 0/*prot*/, 0/*flags*/, -1/*fd*/, 0/*offset*/);
+  if (p == (char*)-1)
+    return 0;
+  ok = 1;
+  for(i = 0; i < NPAGE*PGSIZE; i++)
+    if(p[i] != 0)
+      ok = 0;
+  munmap(p, NPAGE*PGSIZE);
+  return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int r;
+
+  // thread_create mallocs the writer's stack; get that memory from
+  // sbrk now, so that the stack is never at the top of the address
+  // space, which munmap and sbrk shrink.
+  if(thread_create(noop, 0) < 0 || thread_join() < 0){
+    printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+    exit();
+  }
+
+  for(r = 0; r < NROUND; r++){
+    region = mmap(0, NPAGE*PGSIZE, 0/*prot*/, 0/*flags*/, -1/*fd*/, 0/*offset*/);
+    if (region == (char*)-1)
+    {
+      printf(1, "XV6_TEST_OUTPUT : mmap failed\n");
+      exit();
+    }
+    if(startwriter() < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+      exit();
+    }
+    if (munmap((void*)region, NPAGE*PGSIZE) < 0)
+    {
+      printf(1, "XV6_TEST_OUTPUT : munmap failed\n");
+      exit();
+    }
+    if(thread_join() < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_join failed\n");
+      exit();
+    }
+    if(!clean()){
+      printf(1, "XV6_TEST_OUTPUT : freed page written after munmap\n");
+      exit();
+    }
+  }
+  printf(1, "XV6_TEST_OUTPUT : munmap under writer good\n");
+
+  for(r = 0; r < NROUND; r++){
+    region = sbrk(NPAGE*PGSIZE);
+    if(region == (char*)-1){
+      printf(1, "XV6_TEST_OUTPUT : sbrk failed\n");
+      exit();
+    }
+    if(startwriter() < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_create failed\n");
+      exit();
+    }
+    if(sbrk(-NPAGE*PGSIZE) == (char*)-1){
+      printf(1, "XV6_TEST_OUTPUT : sbrk shrink failed\n");
+      exit();
+    }
+    if(thread_join() < 0){
+      printf(1, "XV6_TEST_OUTPUT : thread_join failed\n");
+      exit();
+    }
+    if(!clean()){
+      printf(1, "XV6_TEST_OUTPUT : freed page written after sbrk\n");
+      exit();
+    }
+  }
+  printf(1, "XV6_TEST_OUTPUT : sbrk under writer good\n");
+  exit();
+}